@@ -3,15 +3,21 @@ using std::cerr;
 using std::cout;
 #include <string>
 using std::string;
+#include <vector>
+using std::vector;
 
 #include "scx.hpp"
 
 int main(void) {
   SCXFile scxfile;
+  // So scenes with the same text can be found by id
+  scxfile.set_interning(true);
 
   const auto sourceFile = string{"../../avking.scx"};
 
-  if (!scxfile.read(sourceFile)) {
+  // Only one section is needed, so decode only that one.
+  if (!scxfile.read(sourceFile, SCXFile::load_mode::lazy) ||
+      !scxfile.verify_checksum()) {
     cerr << "Failed to read source: " << sourceFile << "\n";
     return 1;
   }
@@ -29,19 +35,37 @@ int main(void) {
   cout << "\"Content-Transfer-Encoding: 8bit\\n\"\n";
   cout << "\n";
 
-  // TODO: msgid is a unique key, and some duplicate (Command-only?) scenes
-  // exist
+  // msgid is a unique key, and some duplicate (Command-only?) scenes exist,
+  // so each text is listed once with every scene using it.
+  vector<vector<std::size_t>> scenes_by_text;
   for (std::size_t i = 0; i < scxfile.scene_count(); ++i) {
-    const auto& scene = scxfile.scene(i);
-    if (scene.text.empty()) {
+    const auto& text = scxfile.scene(i).text;
+    if (text.empty()) {
+      continue;
+    }
+    const auto id = text.interned().id();
+    if (id >= scenes_by_text.size()) {
+      scenes_by_text.resize(id + 1);
+    }
+    scenes_by_text[id].push_back(i);
+  }
+
+  for (const auto& scenes : scenes_by_text) {
+    if (scenes.empty()) {
       continue;
     }
     // TODO: Skip scenes that contain only commands.
     // TODO: Split dialog lines at commands? Otherwise, need to escape the
     // commands since the \n and \r commands raise warnings in Poedit
-    cout << "#. Chapter " << scene.chapter << " Scene " << scene.scene << "\n";
-    cout << "#: Scene(" << i << ").text\n";
-    cout << "msgid \"" << scene.text << "\"\n";
+    for (auto i : scenes) {
+      const auto& scene = scxfile.scene(i);
+      cout << "#. Chapter " << scene.chapter << " Scene " << scene.scene
+           << "\n";
+    }
+    for (auto i : scenes) {
+      cout << "#: Scene(" << i << ").text\n";
+    }
+    cout << "msgid \"" << scxfile.scene(scenes.front()).text << "\"\n";
     cout << "msgstr \"\"\n\n";
   }
   return 0;
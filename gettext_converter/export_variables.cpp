@@ -3,15 +3,21 @@ using std::cerr;
 using std::cout;
 #include <string>
 using std::string;
+#include <vector>
+using std::vector;
 
 #include "scx.hpp"
 
 int main(void) {
   SCXFile scxfile;
+  // So names and comments with the same text can be found by id
+  scxfile.set_interning(true);
 
   const auto sourceFile = string{"../../avking.scx"};
 
-  if (!scxfile.read(sourceFile)) {
+  // Only one section is needed, so decode only that one.
+  if (!scxfile.read(sourceFile, SCXFile::load_mode::lazy) ||
+      !scxfile.verify_checksum()) {
     cerr << "Failed to read source: " << sourceFile << "\n";
     return 1;
   }
@@ -29,17 +35,39 @@ int main(void) {
   cout << "\"Content-Transfer-Encoding: 8bit\\n\"\n";
   cout << "\n";
 
-  // TODO: msgid is a unique key, and some duplicate comments exist.
+  // msgid is a unique key, and some duplicate comments exist, so each text
+  // is listed once with every name and comment using it.
+  vector<vector<string>> references_by_text;
+  vector<StringPool::handle> texts;
+  const StringPool& pool = *scxfile.string_pool();
+  auto add = [&](const FixedText& text, const string& reference) {
+    const auto interned = text.interned(pool);
+    const auto id = interned.id();
+    if (id >= texts.size()) {
+      texts.resize(id + 1);
+      references_by_text.resize(id + 1);
+    }
+    texts[id] = interned;
+    references_by_text[id].push_back(reference);
+  };
   for (std::size_t i = 0; i < scxfile.variable_count(); ++i) {
     const auto& variable = scxfile.variable(i);
-    cout << "#: Variable(" << i << ").name\n";
-    cout << "msgid \"" << variable.name << "\"\n";
-    cout << "msgstr \"\"\n\n";
+    const auto index = std::to_string(i);
+    add(variable.name, "Variable(" + index + ").name");
     if (!variable.comment.empty()) {
-      cout << "#: Variable(" << i << ").comment\n";
-      cout << "msgid \"" << variable.comment << "\"\n";
-      cout << "msgstr \"\"\n\n";
+      add(variable.comment, "Variable(" + index + ").comment");
     }
   }
+
+  for (std::size_t id = 0; id < texts.size(); ++id) {
+    if (references_by_text[id].empty()) {
+      continue;
+    }
+    for (const auto& reference : references_by_text[id]) {
+      cout << "#: " << reference << "\n";
+    }
+    cout << "msgid \"" << texts[id].str() << "\"\n";
+    cout << "msgstr \"\"\n\n";
+  }
   return 0;
 }
@@ -1,3 +1,7 @@
+#pragma once
+
+#include "FixedText.hpp"
+
 #include <string>
 
 #include <cstdint>
@@ -12,10 +16,10 @@ struct AssetName {
 
   // Writing API
   using fixed_string_span_out = gsl::multi_span<gsl::byte, 0x20>;
-  void write_data(fixed_string_span_out string0,
-                  fixed_string_span_out string1) const;
+  void write_data(fixed_string_span_out string0, fixed_string_span_out string1,
+                  cp932::unmappable policy = cp932::unmappable::skip) const;
 
   // utf-8 encoded
-  std::string name;
-  std::string abbreviation;
+  FixedText name;
+  FixedText abbreviation;
 };
@@ -0,0 +1,378 @@
+#include "CP932.hpp"
+
+#include "CP932Platform.hpp"
+
+#include <algorithm>
+using std::begin;
+using std::end;
+using std::lower_bound;
+#include <atomic>
+using std::atomic;
+using std::memory_order_relaxed;
+#include <string>
+using std::string;
+#include <utility>
+using std::pair;
+#include <vector>
+using std::vector;
+
+#include <cstddef>
+using std::size_t;
+#include <cstring>
+using std::memchr;
+using std::memcpy;
+#include <cstdint>
+using std::uint16_t;
+using std::uint32_t;
+using std::uint8_t;
+
+#include <gsl/gsl>
+using gsl::multi_span;
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCX_CP932_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// single_byte, lead_row, double_byte, encode_page, encode and best_fit
+#include "cp932_tables.inc"
+
+const uint8_t not_lead = 0xff;
+
+atomic<cp932::converter> selected_converter{cp932::converter::builtin};
+
+bool is_trail(uint8_t byte) {
+  return (byte >= 0x40 && byte <= 0x7e) || (byte >= 0x80 && byte <= 0xfc);
+}
+
+// Length of the run of ASCII at the start of data, stopping at any null if
+// stop_at_null is set
+size_t ascii_prefix(const char* data, size_t size, bool stop_at_null) {
+  size_t i = 0;
+#if defined(SCX_CP932_SSE2)
+  // Sixteen bytes at a time until the block holding the end of the run
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i nulls = stop_at_null ? _mm_set1_epi8(-1) : zero;
+  for (; i + 16 <= size; i += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    const __m128i stop = _mm_or_si128(
+        block, _mm_and_si128(nulls, _mm_cmpeq_epi8(block, zero)));
+    if (_mm_movemask_epi8(stop) != 0) {
+      break;
+    }
+  }
+#endif
+  for (; i < size; ++i) {
+    const auto byte = static_cast<uint8_t>(data[i]);
+    if ((byte == 0 && stop_at_null) || byte >= 0x80) {
+      break;
+    }
+  }
+  return i;
+}
+
+char* append_utf8(char* out, uint16_t code_point) {
+  if (code_point < 0x80) {
+    *out++ = static_cast<char>(code_point);
+  } else if (code_point < 0x800) {
+    *out++ = static_cast<char>(0xc0 | (code_point >> 6));
+    *out++ = static_cast<char>(0x80 | (code_point & 0x3f));
+  } else {
+    *out++ = static_cast<char>(0xe0 | (code_point >> 12));
+    *out++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+    *out++ = static_cast<char>(0x80 | (code_point & 0x3f));
+  }
+  return out;
+}
+
+// Decodes from data[i] up to the next null or size, which i is left at
+char* decode_string(const char* data, size_t size, size_t& i, char* out) {
+  while (i < size) {
+    const size_t ascii = ascii_prefix(data + i, size - i, true);
+    memcpy(out, data + i, ascii);
+    out += ascii;
+    i += ascii;
+    if (i == size || data[i] == '\0') {
+      break;
+    }
+
+    const auto byte = static_cast<uint8_t>(data[i]);
+    const auto row = lead_row[byte];
+    uint16_t code_point;
+    if (row == not_lead) {
+      code_point = single_byte[byte];
+      i += 1;
+    } else if (i + 1 < size && is_trail(static_cast<uint8_t>(data[i + 1]))) {
+      code_point = double_byte[row][static_cast<uint8_t>(data[i + 1])];
+      i += 2;
+    } else {
+      // A lead byte without a trail byte is dropped alone
+      i += 1;
+      continue;
+    }
+
+    if (code_point != 0) {
+      out = append_utf8(out, code_point);
+    }
+  }
+  return out;
+}
+
+const uint32_t invalid_code_point = 0xffffffff;
+
+// Reads the UTF-8 sequence at data[i] and steps past it. A malformed
+// sequence gives invalid_code_point, and only its first byte is stepped past.
+uint32_t next_code_point(const char* data, size_t size, size_t& i) {
+  const auto first = static_cast<uint8_t>(data[i]);
+  size_t length;
+  uint32_t code_point;
+  uint32_t smallest;
+  if (first < 0x80) {
+    ++i;
+    return first;
+  } else if ((first & 0xe0) == 0xc0) {
+    length = 2;
+    code_point = first & 0x1f;
+    smallest = 0x80;
+  } else if ((first & 0xf0) == 0xe0) {
+    length = 3;
+    code_point = first & 0x0f;
+    smallest = 0x800;
+  } else if ((first & 0xf8) == 0xf0) {
+    length = 4;
+    code_point = first & 0x07;
+    smallest = 0x10000;
+  } else {
+    ++i;
+    return invalid_code_point;
+  }
+
+  if (size - i < length) {
+    ++i;
+    return invalid_code_point;
+  }
+  for (size_t k = 1; k < length; ++k) {
+    const auto next = static_cast<uint8_t>(data[i + k]);
+    if ((next & 0xc0) != 0x80) {
+      ++i;
+      return invalid_code_point;
+    }
+    code_point = (code_point << 6) | (next & 0x3f);
+  }
+  // Overlong forms, surrogates, and anything past the end of Unicode
+  if (code_point < smallest || code_point > 0x10ffff ||
+      (code_point >= 0xd800 && code_point <= 0xdfff)) {
+    ++i;
+    return invalid_code_point;
+  }
+
+  i += length;
+  return code_point;
+}
+
+// The code for code_point, or 0 if CP932 has none
+uint16_t lookup(uint32_t code_point) {
+  if (code_point > 0xffff) {
+    return 0;
+  }
+  return encode[encode_page[code_point >> 8]][code_point & 0xff];
+}
+
+uint16_t lookup_best_fit(uint32_t code_point) {
+  auto found = lower_bound(begin(best_fit), end(best_fit), code_point,
+                           [](const uint16_t(&entry)[2], uint32_t value) {
+                             return entry[0] < value;
+                           });
+  return found != end(best_fit) && (*found)[0] == code_point ? (*found)[1]
+                                                             : 0;
+}
+
+// Encodes UTF-8 into out, which has room for out_size bytes, or only counts the
+// bytes if Write is false. Returns the size of the CP932.
+template <bool Write>
+size_t encode_string(const char* data, size_t size, cp932::unmappable policy,
+                     char* out, size_t out_size) {
+  size_t written = 0;
+  size_t i = 0;
+  while (i < size) {
+    const size_t ascii = ascii_prefix(data + i, size - i, false);
+    if (Write) {
+      Expects(written + ascii <= out_size);
+      memcpy(out + written, data + i, ascii);
+    }
+    written += ascii;
+    i += ascii;
+    if (i == size) {
+      break;
+    }
+
+    const uint32_t code_point = next_code_point(data, size, i);
+    uint16_t code =
+        code_point == invalid_code_point ? 0 : lookup(code_point);
+    if (code == 0) {
+      switch (policy) {
+        case cp932::unmappable::skip:
+          continue;
+        case cp932::unmappable::error:
+          throw cp932::conversion_error();
+        case cp932::unmappable::best_fit:
+          code = code_point == invalid_code_point ? 0
+                                                  : lookup_best_fit(code_point);
+          if (code != 0) {
+            break;
+          }
+        // Fall through
+        case cp932::unmappable::replace:
+          code = '?';
+          break;
+      }
+    }
+
+    const size_t code_size = code > 0xff ? 2 : 1;
+    if (Write) {
+      Expects(written + code_size <= out_size);
+      if (code_size == 2) {
+        out[written] = static_cast<char>(code >> 8);
+      }
+      out[written + code_size - 1] = static_cast<char>(code & 0xff);
+    }
+    written += code_size;
+  }
+  return written;
+}
+}
+
+namespace cp932 {
+
+string to_utf8(multi_span<const char> text) {
+  const char* data = text.data();
+  const size_t size = text.size();
+
+  const auto which = selected_converter.load(memory_order_relaxed);
+  if (which != converter::builtin) {
+    const auto end = static_cast<const char*>(memchr(data, 0, size));
+    return platform::to_utf8(which, data, end != nullptr ? end - data : size);
+  }
+
+  // Half-width katakana are the worst case, one byte becoming three
+  string result(size * 3, '\0');
+  size_t i = 0;
+  char* out = decode_string(data, size, i, &result[0]);
+
+  result.resize(out - result.data());
+  return result;
+}
+
+size_t to_utf8(multi_span<const char> text, multi_span<char> out) {
+  const char* data = text.data();
+  const size_t size = text.size();
+  Expects(static_cast<size_t>(out.size()) >= size * 3);
+
+  const auto which = selected_converter.load(memory_order_relaxed);
+  if (which != converter::builtin) {
+    const auto end = static_cast<const char*>(memchr(data, 0, size));
+    const string result =
+        platform::to_utf8(which, data, end != nullptr ? end - data : size);
+    Expects(result.size() <= static_cast<size_t>(out.size()));
+    memcpy(out.data(), result.data(), result.size());
+    return result.size();
+  }
+
+  size_t i = 0;
+  return decode_string(data, size, i, out.data()) - out.data();
+}
+
+string to_utf8_strings(multi_span<const char> text,
+                       vector<pair<size_t, size_t>>& starts) {
+  const char* data = text.data();
+  const size_t size = text.size();
+
+  const auto which = selected_converter.load(memory_order_relaxed);
+  if (which != converter::builtin) {
+    string result;
+    size_t i = 0;
+    while (i < size) {
+      starts.emplace_back(i, result.size());
+      const auto end = static_cast<const char*>(memchr(data + i, 0, size - i));
+      const size_t length = end != nullptr ? end - (data + i) : size - i;
+      result += platform::to_utf8(which, data + i, length);
+      result += '\0';
+      i += length + 1;
+    }
+    return result;
+  }
+
+  // As to_utf8, with a null after each string
+  string result(size * 3 + 1, '\0');
+  char* out = &result[0];
+
+  size_t i = 0;
+  while (i < size) {
+    starts.emplace_back(i, out - result.data());
+    out = decode_string(data, size, i, out);
+    *out++ = '\0';
+    // Past the null
+    ++i;
+  }
+
+  result.resize(out - result.data());
+  return result;
+}
+
+string from_utf8(multi_span<const char> text, unmappable policy) {
+  const char* data = text.data();
+  const size_t size = text.size();
+
+  const auto which = selected_converter.load(memory_order_relaxed);
+  if (which != converter::builtin) {
+    return platform::from_utf8(which, data, size, policy);
+  }
+
+  // Nothing grows: ASCII stays one byte, longer sequences become at most two,
+  // and each malformed byte at most one.
+  string result(size, '\0');
+  result.resize(encode_string<true>(data, size, policy, &result[0], size));
+  return result;
+}
+
+size_t from_utf8_size(multi_span<const char> text, unmappable policy) {
+  const auto which = selected_converter.load(memory_order_relaxed);
+  if (which != converter::builtin) {
+    return platform::from_utf8(which, text.data(), text.size(), policy).size();
+  }
+  return encode_string<false>(text.data(), text.size(), policy, nullptr, 0);
+}
+
+size_t from_utf8(multi_span<const char> text, multi_span<char> out,
+                 unmappable policy) {
+  const auto which = selected_converter.load(memory_order_relaxed);
+  if (which != converter::builtin) {
+    const string result =
+        platform::from_utf8(which, text.data(), text.size(), policy);
+    Expects(result.size() <= static_cast<size_t>(out.size()));
+    memcpy(out.data(), result.data(), result.size());
+    return result.size();
+  }
+  return encode_string<true>(text.data(), text.size(), policy, out.data(),
+                             out.size());
+}
+
+bool converter_available(converter which) {
+  return platform::available(which);
+}
+
+bool set_converter(converter which) {
+  if (!platform::available(which)) {
+    return false;
+  }
+  selected_converter.store(which, memory_order_relaxed);
+  return true;
+}
+
+converter current_converter() {
+  return selected_converter.load(memory_order_relaxed);
+}
+}
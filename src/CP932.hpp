@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+
+#include <gsl/gsl>
+
+// Text in an SCX file is in Windows code-page 932. See Scene::read_data for
+// the naming mess around it.
+// The tables are generated at build time from CP932.TXT, which follows
+// http://www.unicode.org/Public/MAPPINGS/VENDORS/MICSFT/WINDOWS/CP932.TXT
+// and CP932BestFit.txt.
+namespace cp932 {
+
+// Decodes text up to its first null, or its end if it has none. Bytes which do
+// not form a mapped character are dropped, as boost::locale::conv does by
+// default.
+std::string to_utf8(gsl::multi_span<const char> text);
+// As above, into out, which needs room for three bytes for each byte of text.
+// Returns the size of the UTF-8, which is not null-terminated.
+std::size_t to_utf8(gsl::multi_span<const char> text,
+                    gsl::multi_span<char> out);
+
+// Decodes every null-terminated string in text in one pass, into one buffer
+// in which each is followed by a null. A string cut off by the end of text is
+// ended there. For each string, starts gets where it begins in text and in the
+// result, in order.
+std::string to_utf8_strings(
+    gsl::multi_span<const char> text,
+    std::vector<std::pair<std::size_t, std::size_t>>& starts);
+
+// What from_utf8 does with a character CP932 has no code for, or with bytes
+// which are not valid UTF-8
+enum class unmappable {
+  // Drop it, as boost::locale::conv does by default
+  skip,
+  // Throw conversion_error
+  error,
+  // Use the closest character listed in CP932BestFit.txt, or replace it if
+  // there is none
+  best_fit,
+  // Use '?', as the Windows API does
+  replace,
+};
+
+class conversion_error : public std::runtime_error {
+ public:
+  conversion_error() : std::runtime_error("Conversion to CP932 failed") {}
+};
+
+std::string from_utf8(gsl::multi_span<const char> text,
+                      unmappable policy = unmappable::skip);
+// The size of the CP932 from_utf8 gives, without keeping it
+std::size_t from_utf8_size(gsl::multi_span<const char> text,
+                           unmappable policy = unmappable::skip);
+// As from_utf8, into out, which needs room for from_utf8_size bytes. Returns
+// the size of the CP932, which is not null-terminated.
+std::size_t from_utf8(gsl::multi_span<const char> text,
+                      gsl::multi_span<char> out,
+                      unmappable policy = unmappable::skip);
+
+// What to_utf8 and from_utf8 convert with. The platform converters are for
+// compatibility with the results of boost::locale::conv, which uses one of
+// them, and are only there if the library was built with them.
+enum class converter {
+  // The tables generated from CP932.TXT
+  builtin,
+  // ICU's "windows-932", which is IBM-943 and so differs on a few control
+  // codes
+  icu,
+  // iconv's "WINDOWS-31J"
+  iconv,
+};
+
+bool converter_available(converter which);
+// For every thread. Returns false if which is not available.
+bool set_converter(converter which);
+converter current_converter();
+}
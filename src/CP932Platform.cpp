@@ -0,0 +1,339 @@
+#include "CP932Platform.hpp"
+
+#include <stdexcept>
+using std::runtime_error;
+#include <string>
+using std::string;
+
+#include <cerrno>
+#include <cstddef>
+using std::size_t;
+#include <cstdint>
+using std::uint8_t;
+
+#if defined(SCX_WITH_ICU)
+#include <unicode/ucnv.h>
+#endif
+
+#if defined(SCX_WITH_ICONV)
+#include <iconv.h>
+#endif
+
+namespace {
+
+#if defined(SCX_WITH_ICU)
+
+struct icu_converters {
+  icu_converters() : cp932(open("windows-932")), utf8(nullptr) {
+    try {
+      utf8 = open("UTF-8");
+    } catch (...) {
+      ucnv_close(cp932);
+      throw;
+    }
+  }
+  ~icu_converters() {
+    ucnv_close(cp932);
+    ucnv_close(utf8);
+  }
+  icu_converters(const icu_converters&) = delete;
+  icu_converters& operator=(const icu_converters&) = delete;
+
+  static UConverter* open(const char* name) {
+    UErrorCode error = U_ZERO_ERROR;
+    UConverter* converter = ucnv_open(name, &error);
+    if (U_FAILURE(error)) {
+      throw runtime_error("Cannot open ICU converter");
+    }
+    // What to_utf8 and from_utf8 substitute, where they do
+    ucnv_setSubstChars(converter, "?", 1, &error);
+    return converter;
+  }
+
+  UConverter* cp932;
+  UConverter* utf8;
+};
+
+icu_converters& icu() {
+  thread_local icu_converters converters;
+  return converters;
+}
+
+// Converts all of text from one converter's charset to the other's, growing
+// the result as needed. Returns false if a callback stopped the conversion.
+bool icu_convert(UConverter* to, UConverter* from, const char* text,
+                 size_t size, string& result) {
+  result.resize(size * 3 + 16);
+  for (;;) {
+    char* target = &result[0];
+    const char* source = text;
+    UChar pivot[0x100];
+    UChar* pivot_source = pivot;
+    UChar* pivot_target = pivot;
+    UErrorCode error = U_ZERO_ERROR;
+    ucnv_convertEx(to, from, &target, result.data() + result.size(), &source,
+                   text + size, pivot, &pivot_source, &pivot_target,
+                   pivot + 0x100, true, true, &error);
+    if (error == U_BUFFER_OVERFLOW_ERROR) {
+      result.resize(result.size() * 2);
+      continue;
+    }
+    if (U_FAILURE(error)) {
+      return false;
+    }
+    result.resize(target - result.data());
+    return true;
+  }
+}
+
+string icu_to_utf8(const char* text, size_t size) {
+  auto& converters = icu();
+  UErrorCode error = U_ZERO_ERROR;
+  // Dropped, as boost::locale::conv does by default
+  ucnv_setToUCallBack(converters.cp932, UCNV_TO_U_CALLBACK_SKIP, nullptr,
+                      nullptr, nullptr, &error);
+  string result;
+  if (U_FAILURE(error) ||
+      !icu_convert(converters.utf8, converters.cp932, text, size, result)) {
+    throw runtime_error("ICU conversion from CP932 failed");
+  }
+  return result;
+}
+
+string icu_from_utf8(const char* text, size_t size,
+                     cp932::unmappable policy) {
+  auto& converters = icu();
+  UErrorCode error = U_ZERO_ERROR;
+  switch (policy) {
+    case cp932::unmappable::skip:
+      ucnv_setToUCallBack(converters.utf8, UCNV_TO_U_CALLBACK_SKIP, nullptr,
+                          nullptr, nullptr, &error);
+      ucnv_setFromUCallBack(converters.cp932, UCNV_FROM_U_CALLBACK_SKIP,
+                            nullptr, nullptr, nullptr, &error);
+      break;
+    case cp932::unmappable::error:
+      ucnv_setToUCallBack(converters.utf8, UCNV_TO_U_CALLBACK_STOP, nullptr,
+                          nullptr, nullptr, &error);
+      ucnv_setFromUCallBack(converters.cp932, UCNV_FROM_U_CALLBACK_STOP,
+                            nullptr, nullptr, nullptr, &error);
+      break;
+    case cp932::unmappable::best_fit:
+    case cp932::unmappable::replace:
+      // Malformed UTF-8 becomes U+FFFD, which CP932 then has no code for
+      ucnv_setToUCallBack(converters.utf8, UCNV_TO_U_CALLBACK_SUBSTITUTE,
+                          nullptr, nullptr, nullptr, &error);
+      ucnv_setFromUCallBack(converters.cp932, UCNV_FROM_U_CALLBACK_SUBSTITUTE,
+                            nullptr, nullptr, nullptr, &error);
+      break;
+  }
+  // ICU's fallback mappings are its best fit
+  ucnv_setFallback(converters.cp932, policy == cp932::unmappable::best_fit);
+  if (U_FAILURE(error)) {
+    throw runtime_error("ICU conversion to CP932 failed");
+  }
+
+  string result;
+  if (!icu_convert(converters.cp932, converters.utf8, text, size, result)) {
+    throw cp932::conversion_error();
+  }
+  return result;
+}
+
+#endif
+
+#if defined(SCX_WITH_ICONV)
+
+// Length of the UTF-8 sequence a byte starts, or 1 if it starts none
+size_t sequence_length(char first) {
+  const auto byte = static_cast<uint8_t>(first);
+  if ((byte & 0xe0) == 0xc0) {
+    return 2;
+  } else if ((byte & 0xf0) == 0xe0) {
+    return 3;
+  } else if ((byte & 0xf8) == 0xf0) {
+    return 4;
+  }
+  return 1;
+}
+
+const iconv_t not_open = reinterpret_cast<iconv_t>(-1);
+
+struct iconv_handles {
+  iconv_handles() : to_utf8(not_open), from_utf8(not_open), best_fit(not_open) {
+    to_utf8 = iconv_open("UTF-8", "WINDOWS-31J");
+    from_utf8 = iconv_open("WINDOWS-31J", "UTF-8");
+    best_fit = iconv_open("WINDOWS-31J//TRANSLIT", "UTF-8");
+    if (to_utf8 == not_open || from_utf8 == not_open || best_fit == not_open) {
+      close();
+      throw runtime_error("Cannot open iconv converter");
+    }
+  }
+  ~iconv_handles() { close(); }
+  iconv_handles(const iconv_handles&) = delete;
+  iconv_handles& operator=(const iconv_handles&) = delete;
+
+  void close() {
+    for (auto handle : {to_utf8, from_utf8, best_fit}) {
+      if (handle != not_open) {
+        iconv_close(handle);
+      }
+    }
+  }
+
+  iconv_t to_utf8;
+  iconv_t from_utf8;
+  iconv_t best_fit;
+};
+
+iconv_handles& iconv_converters() {
+  thread_local iconv_handles handles;
+  return handles;
+}
+
+// Converts as much of [in, in + in_left) as it can onto the end of result,
+// growing it as needed. Stops at anything iconv cannot convert, which is left
+// at in.
+void iconv_convert(iconv_t handle, const char*& in, size_t& in_left,
+                   string& result, size_t& used) {
+  // Back to the initial state
+  iconv(handle, nullptr, nullptr, nullptr, nullptr);
+  for (;;) {
+    char* source = const_cast<char*>(in);
+    char* target = &result[used];
+    size_t out_left = result.size() - used;
+    const size_t converted =
+        iconv(handle, &source, &in_left, &target, &out_left);
+    const int error = errno;
+    in = source;
+    used = target - result.data();
+    if (converted != static_cast<size_t>(-1) || error != E2BIG) {
+      return;
+    }
+    result.resize(result.size() * 2);
+  }
+}
+
+string iconv_to_utf8(const char* text, size_t size) {
+  auto handle = iconv_converters().to_utf8;
+  string result(size * 3 + 16, '\0');
+  size_t used = 0;
+  const char* in = text;
+  size_t in_left = size;
+  while (in_left > 0) {
+    iconv_convert(handle, in, in_left, result, used);
+    if (in_left > 0) {
+      // Dropped a byte at a time, as with the builtin tables
+      ++in;
+      --in_left;
+    }
+  }
+  result.resize(used);
+  return result;
+}
+
+string iconv_from_utf8(const char* text, size_t size,
+                       cp932::unmappable policy) {
+  auto& handles = iconv_converters();
+  string result(size + 16, '\0');
+  size_t used = 0;
+  const char* in = text;
+  size_t in_left = size;
+  while (in_left > 0) {
+    iconv_convert(handles.from_utf8, in, in_left, result, used);
+    if (in_left == 0) {
+      break;
+    }
+
+    // Something iconv cannot convert, or which is not UTF-8
+    size_t length = sequence_length(*in);
+    if (length > in_left) {
+      length = 1;
+    }
+    switch (policy) {
+      case cp932::unmappable::skip:
+        break;
+      case cp932::unmappable::error:
+        throw cp932::conversion_error();
+      case cp932::unmappable::best_fit: {
+        const char* fit = in;
+        size_t fit_left = length;
+        const size_t before = used;
+        iconv_convert(handles.best_fit, fit, fit_left, result, used);
+        if (fit_left == 0 && used != before) {
+          break;
+        }
+        used = before;
+      }
+      // Fall through
+      case cp932::unmappable::replace:
+        if (used == result.size()) {
+          result.resize(result.size() * 2);
+        }
+        result[used++] = '?';
+        break;
+    }
+    in += length;
+    in_left -= length;
+  }
+  result.resize(used);
+  return result;
+}
+
+#endif
+}
+
+namespace cp932 {
+namespace platform {
+
+bool available(converter which) {
+  switch (which) {
+    case converter::builtin:
+      return true;
+    case converter::icu:
+#if defined(SCX_WITH_ICU)
+      return true;
+#else
+      return false;
+#endif
+    case converter::iconv:
+#if defined(SCX_WITH_ICONV)
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+string to_utf8(converter which, const char* text, size_t size) {
+  switch (which) {
+#if defined(SCX_WITH_ICU)
+    case converter::icu:
+      return icu_to_utf8(text, size);
+#endif
+#if defined(SCX_WITH_ICONV)
+    case converter::iconv:
+      return iconv_to_utf8(text, size);
+#endif
+    default:
+      throw runtime_error("CP932 converter not available");
+  }
+}
+
+string from_utf8(converter which, const char* text, size_t size,
+                 unmappable policy) {
+  switch (which) {
+#if defined(SCX_WITH_ICU)
+    case converter::icu:
+      return icu_from_utf8(text, size, policy);
+#endif
+#if defined(SCX_WITH_ICONV)
+    case converter::iconv:
+      return iconv_from_utf8(text, size, policy);
+#endif
+    default:
+      throw runtime_error("CP932 converter not available");
+  }
+}
+}
+}
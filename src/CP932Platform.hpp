@@ -0,0 +1,23 @@
+#pragma once
+
+#include "CP932.hpp"
+
+#include <string>
+
+#include <cstddef>
+
+// The converters behind cp932::converter::icu and cp932::converter::iconv.
+// boost::locale::conv opens a converter for every string and closes it again.
+// Here each thread opens its own the first time it converts, and keeps them
+// until it exits.
+namespace cp932 {
+namespace platform {
+
+bool available(converter which);
+
+// text is size bytes without a null
+std::string to_utf8(converter which, const char* text, std::size_t size);
+std::string from_utf8(converter which, const char* text, std::size_t size,
+                      unmappable policy);
+}
+}
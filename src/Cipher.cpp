@@ -0,0 +1,412 @@
+#include "Cipher.hpp"
+
+#include <algorithm>
+using std::min;
+#include <array>
+using std::array;
+#include <atomic>
+using std::atomic;
+#include <numeric>
+using std::accumulate;
+#include <system_error>
+using std::system_error;
+#include <thread>
+using std::thread;
+#include <vector>
+using std::vector;
+
+#include <cstddef>
+using std::size_t;
+#include <cstdint>
+using std::int8_t;
+using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
+
+#include <gsl/gsl>
+using gsl::byte;
+using gsl::multi_span;
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCX_CIPHER_X86_64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+// MSVC allows AVX2 intrinsics in any function, GCC and Clang need to be told.
+#if defined(__GNUC__)
+#define SCX_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SCX_TARGET_AVX2
+#endif
+#endif
+
+namespace {
+
+// 0x535f5c in the avking.exe image
+static const array<uint8_t, 11> ENCRYPTION_KEY{
+    0xa9, 0xb3, 0xf2, 0x87, 0xdc, 0xaf, 0x13, 0x67, 0xd5, 0x91, 0xec};
+
+using cipher::keystream_period;
+
+// The SIMD kernels load up to this many keystream bytes from any position
+// within the period, so the table carries that many bytes past its end.
+static const size_t keystream_overhang = 64;
+
+struct keystream_table {
+  keystream_table() {
+    for (size_t i = 0; i < bytes.size(); ++i) {
+      uint8_t key = ENCRYPTION_KEY[i % ENCRYPTION_KEY.size()];
+      // Wrapping is expected here.
+      bytes[i] = key + static_cast<uint8_t>(i);
+    }
+  }
+
+  array<uint8_t, keystream_period + keystream_overhang> bytes;
+};
+
+const uint8_t* keystream() {
+  static const keystream_table table;
+  return table.bytes.data();
+}
+
+// The checksum is taken over the encrypted bytes, which are the input when
+// decrypting and the output when encrypting.
+enum class checksum_of { input, output };
+
+template <checksum_of which>
+uint32_t crypt_scalar(const uint8_t* in, uint8_t* out, size_t size,
+                      size_t pos) {
+  const uint8_t* stream = keystream();
+  uint32_t calc = 0;
+  for (size_t i = 0; i < size; ++i) {
+    const uint8_t encrypted = in[i];
+    // Unsigned math
+    const uint8_t result = encrypted ^ stream[pos];
+    out[i] = result;
+    // Checksum: Signed math
+    calc += static_cast<int8_t>(which == checksum_of::input ? encrypted
+                                                             : result);
+    if (++pos == keystream_period) {
+      pos = 0;
+    }
+  }
+  return calc;
+}
+
+uint32_t checksum_scalar(const uint8_t* data, size_t size) {
+  uint32_t calc = 0;
+  for (size_t i = 0; i < size; ++i) {
+    calc += static_cast<int8_t>(data[i]);
+  }
+  return calc;
+}
+
+#if defined(SCX_CIPHER_X86_64)
+
+// The signed-byte sum is computed as an unsigned sum of (byte ^ 0x80), which
+// psadbw does eight bytes at a time, less 0x80 for every byte summed.
+inline uint32_t unbias_sum(uint64_t biased_sum, size_t count) {
+  return static_cast<uint32_t>(biased_sum -
+                               0x80 * static_cast<uint64_t>(count));
+}
+
+inline uint64_t horizontal_sum(__m128i sums) {
+  const __m128i high = _mm_unpackhi_epi64(sums, sums);
+  return static_cast<uint64_t>(_mm_cvtsi128_si64(sums)) +
+         static_cast<uint64_t>(_mm_cvtsi128_si64(high));
+}
+
+// 32 bytes per step, as two 16-byte vectors.
+template <checksum_of which>
+uint32_t crypt_sse2(const uint8_t* in, uint8_t* out, size_t size, size_t pos) {
+  const uint8_t* stream = keystream();
+  const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sums = zero;
+
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    const __m128i in0 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+    const __m128i in1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 16));
+    const __m128i key0 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(stream + pos));
+    const __m128i key1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(stream + pos + 16));
+    const __m128i out0 = _mm_xor_si128(in0, key0);
+    const __m128i out1 = _mm_xor_si128(in1, key1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), out0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 16), out1);
+
+    const __m128i sum0 = which == checksum_of::input ? in0 : out0;
+    const __m128i sum1 = which == checksum_of::input ? in1 : out1;
+    sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_xor_si128(sum0, bias), zero));
+    sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_xor_si128(sum1, bias), zero));
+
+    pos += 32;
+    if (pos >= keystream_period) {
+      pos -= keystream_period;
+    }
+  }
+
+  return unbias_sum(horizontal_sum(sums), i) +
+         crypt_scalar<which>(in + i, out + i, size - i, pos);
+}
+
+uint32_t checksum_sse2(const uint8_t* data, size_t size) {
+  const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sums = zero;
+
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    const __m128i in0 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    const __m128i in1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+    sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_xor_si128(in0, bias), zero));
+    sums = _mm_add_epi64(sums, _mm_sad_epu8(_mm_xor_si128(in1, bias), zero));
+  }
+
+  return unbias_sum(horizontal_sum(sums), i) +
+         checksum_scalar(data + i, size - i);
+}
+
+SCX_TARGET_AVX2 inline uint64_t horizontal_sum(__m256i sums) {
+  return horizontal_sum(_mm_add_epi64(_mm256_castsi256_si128(sums),
+                                      _mm256_extracti128_si256(sums, 1)));
+}
+
+// 64 bytes per step, as two 32-byte vectors.
+template <checksum_of which>
+SCX_TARGET_AVX2 uint32_t crypt_avx2(const uint8_t* in, uint8_t* out,
+                                    size_t size, size_t pos) {
+  const uint8_t* stream = keystream();
+  const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80));
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sums = zero;
+
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    const __m256i in0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+    const __m256i in1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 32));
+    const __m256i key0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stream + pos));
+    const __m256i key1 = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(stream + pos + 32));
+    const __m256i out0 = _mm256_xor_si256(in0, key0);
+    const __m256i out1 = _mm256_xor_si256(in1, key1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), out0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 32), out1);
+
+    const __m256i sum0 = which == checksum_of::input ? in0 : out0;
+    const __m256i sum1 = which == checksum_of::input ? in1 : out1;
+    sums = _mm256_add_epi64(
+        sums, _mm256_sad_epu8(_mm256_xor_si256(sum0, bias), zero));
+    sums = _mm256_add_epi64(
+        sums, _mm256_sad_epu8(_mm256_xor_si256(sum1, bias), zero));
+
+    pos += 64;
+    if (pos >= keystream_period) {
+      pos -= keystream_period;
+    }
+  }
+
+  return unbias_sum(horizontal_sum(sums), i) +
+         crypt_sse2<which>(in + i, out + i, size - i, pos);
+}
+
+SCX_TARGET_AVX2 uint32_t checksum_avx2(const uint8_t* data, size_t size) {
+  const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80));
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sums = zero;
+
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    const __m256i in0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    const __m256i in1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+    sums = _mm256_add_epi64(
+        sums, _mm256_sad_epu8(_mm256_xor_si256(in0, bias), zero));
+    sums = _mm256_add_epi64(
+        sums, _mm256_sad_epu8(_mm256_xor_si256(in1, bias), zero));
+  }
+
+  return unbias_sum(horizontal_sum(sums), i) +
+         checksum_sse2(data + i, size - i);
+}
+
+bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  __cpuid(info, 1);
+  // OSXSAVE and AVX, then the OS must be saving the YMM state.
+  const int osxsave_avx = (1 << 27) | (1 << 28);
+  if ((info[2] & osxsave_avx) != osxsave_avx || (_xgetbv(0) & 0x6) != 0x6) {
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif  // SCX_CIPHER_X86_64
+
+bool kernel_supported(cipher::kernel k) {
+  switch (k) {
+    case cipher::kernel::scalar:
+      return true;
+#if defined(SCX_CIPHER_X86_64)
+    // SSE2 is part of the x86-64 baseline.
+    case cipher::kernel::sse2:
+      return true;
+    case cipher::kernel::avx2:
+      return cpu_has_avx2();
+#endif
+    default:
+      return false;
+  }
+}
+
+cipher::kernel best_kernel() {
+  if (kernel_supported(cipher::kernel::avx2)) {
+    return cipher::kernel::avx2;
+  }
+  if (kernel_supported(cipher::kernel::sse2)) {
+    return cipher::kernel::sse2;
+  }
+  return cipher::kernel::scalar;
+}
+
+atomic<cipher::kernel>& current_kernel() {
+  static atomic<cipher::kernel> current{best_kernel()};
+  return current;
+}
+
+template <checksum_of which>
+uint32_t crypt_serial(const uint8_t* in, uint8_t* out, size_t size,
+                      size_t offset) {
+  const size_t pos = offset % keystream_period;
+
+  switch (current_kernel().load(std::memory_order_relaxed)) {
+#if defined(SCX_CIPHER_X86_64)
+    case cipher::kernel::avx2:
+      return crypt_avx2<which>(in, out, size, pos);
+    case cipher::kernel::sse2:
+      return crypt_sse2<which>(in, out, size, pos);
+#endif
+    default:
+      return crypt_scalar<which>(in, out, size, pos);
+  }
+}
+
+size_t chunk_count(size_t size, unsigned threads) {
+  if (threads == 0) {
+    threads = thread::hardware_concurrency();
+  }
+  return std::max<size_t>(1, min<size_t>(threads,
+                                         size / cipher::parallel_chunk_size));
+}
+
+// Both the cipher and the checksum depend only on the position within the
+// encrypted region, so each chunk can be done on its own and the partial
+// checksums added up afterwards.
+template <checksum_of which>
+uint32_t crypt(multi_span<const byte> in, multi_span<byte> out, size_t offset,
+               unsigned threads) {
+  Expects(in.size() == out.size());
+  const auto in_bytes = reinterpret_cast<const uint8_t*>(in.data());
+  const auto out_bytes = reinterpret_cast<uint8_t*>(out.data());
+  const auto size = static_cast<size_t>(in.size());
+
+  const size_t chunks = chunk_count(size, threads);
+  if (chunks == 1) {
+    return crypt_serial<which>(in_bytes, out_bytes, size, offset);
+  }
+
+  // Keep the chunk boundaries on whole vector steps, so only the last chunk
+  // has a scalar tail. Rounding up the ceiling keeps chunks * chunk_size at
+  // least size, so no bytes are left past the last chunk.
+  const size_t chunk_size = ((size + chunks - 1) / chunks + 63) & ~size_t{63};
+  vector<uint32_t> partial(chunks, 0);
+  auto run_chunk = [=, &partial](size_t chunk) {
+    const size_t begin = chunk * chunk_size;
+    if (begin < size) {
+      partial[chunk] =
+          crypt_serial<which>(in_bytes + begin, out_bytes + begin,
+                              min(chunk_size, size - begin), offset + begin);
+    }
+  };
+
+  // The calling thread takes the first chunk, and any chunks we could not get
+  // a thread for.
+  vector<thread> workers;
+  workers.reserve(chunks - 1);
+  size_t chunk = 1;
+  try {
+    for (; chunk < chunks; ++chunk) {
+      workers.emplace_back(run_chunk, chunk);
+    }
+  } catch (const system_error&) {
+  }
+  run_chunk(0);
+  for (; chunk < chunks; ++chunk) {
+    run_chunk(chunk);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  return accumulate(partial.cbegin(), partial.cend(), uint32_t{0});
+}
+}
+
+namespace cipher {
+
+kernel active_kernel() { return current_kernel().load(); }
+
+bool select_kernel(kernel k) {
+  if (!kernel_supported(k)) {
+    return false;
+  }
+  current_kernel().store(k);
+  return true;
+}
+
+uint32_t decrypt(multi_span<const byte> in, multi_span<byte> out,
+                 size_t offset, unsigned threads) {
+  return crypt<checksum_of::input>(in, out, offset, threads);
+}
+
+uint32_t encrypt(multi_span<const byte> in, multi_span<byte> out,
+                 size_t offset, unsigned threads) {
+  return crypt<checksum_of::output>(in, out, offset, threads);
+}
+
+uint32_t checksum(multi_span<const byte> data) {
+  const auto bytes = reinterpret_cast<const uint8_t*>(data.data());
+  const auto size = static_cast<size_t>(data.size());
+
+  switch (current_kernel().load(std::memory_order_relaxed)) {
+#if defined(SCX_CIPHER_X86_64)
+    case kernel::avx2:
+      return checksum_avx2(bytes, size);
+    case kernel::sse2:
+      return checksum_sse2(bytes, size);
+#endif
+    default:
+      return checksum_scalar(bytes, size);
+  }
+}
+}
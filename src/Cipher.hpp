@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <gsl/gsl>
+
+// Everything in an SCX file after the SCXFileIdentifier is XOR'd against a
+// keystream, and the identifier carries a checksum of the encrypted bytes.
+// The routine at 0x4352a0 in the avking.exe image does both in one pass.
+namespace cipher {
+
+// The keystream byte at encrypted-region offset i is
+//  ENCRYPTION_KEY[i % 11] + (uint8_t)i
+// so it repeats every lcm(11, 256) bytes.
+static const std::size_t keystream_period = 11 * 256;
+
+enum class kernel {
+  scalar,
+  sse2,
+  avx2,
+};
+
+// The kernel used by decrypt, encrypt and checksum. Chosen on first use from
+// what the CPU supports.
+kernel active_kernel();
+
+// Overrides the kernel choice, mostly for testing. Returns false and leaves the
+// choice alone if this CPU or build cannot run the requested kernel.
+bool select_kernel(kernel k);
+
+// decrypt and encrypt split their input into chunks of at least this size
+// and hand each chunk to its own thread. Smaller inputs are done serially.
+static const std::size_t parallel_chunk_size = 1 << 20;
+
+// Decrypts in into out, which may be the same memory. offset is the position
+// of in[0] within the encrypted region. Returns the checksum of the encrypted
+// (input) bytes.
+// threads limits the number of threads used, 0 meaning one per hardware
+// thread.
+std::uint32_t decrypt(gsl::multi_span<const gsl::byte> in,
+                      gsl::multi_span<gsl::byte> out, std::size_t offset,
+                      unsigned threads = 1);
+
+// Encrypts in into out, which may be the same memory. offset is the position
+// of in[0] within the encrypted region. Returns the checksum of the encrypted
+// (output) bytes.
+// threads limits the number of threads used, 0 meaning one per hardware
+// thread.
+std::uint32_t encrypt(gsl::multi_span<const gsl::byte> in,
+                      gsl::multi_span<gsl::byte> out, std::size_t offset,
+                      unsigned threads = 1);
+
+// Checksum: the sum of the bytes as signed values, wrapping at 32 bits.
+std::uint32_t checksum(gsl::multi_span<const gsl::byte> data);
+}
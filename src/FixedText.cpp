@@ -0,0 +1,119 @@
+#include "FixedText.hpp"
+
+#include <memory>
+using std::shared_ptr;
+#include <ostream>
+using std::ostream;
+#include <stdexcept>
+using std::length_error;
+#include <string>
+using std::string;
+
+#include <cstddef>
+using std::ptrdiff_t;
+using std::size_t;
+#include <cstring>
+using std::memchr;
+using std::memcmp;
+using std::memcpy;
+using std::strlen;
+
+#include <gsl/gsl>
+using gsl::multi_span;
+using gsl::narrow_cast;
+
+namespace {
+bool equal(const char* lhs, size_t lhs_size, const char* rhs,
+           size_t rhs_size) {
+  return lhs_size == rhs_size && memcmp(lhs, rhs, lhs_size) == 0;
+}
+}
+
+const size_t FixedText::capacity;
+const std::uint8_t FixedText::no_cp932;
+const std::uint32_t FixedText::not_interned;
+
+FixedText::FixedText(const string& utf8) : FixedText() {
+  assign(utf8.data(), utf8.size());
+}
+
+FixedText FixedText::from_cp932(multi_span<const char> cp932) {
+  Expects(cp932.size() <= static_cast<ptrdiff_t>(fixed_string_size));
+  const auto end =
+      static_cast<const char*>(memchr(cp932.data(), 0, cp932.size()));
+  const size_t size = end != nullptr ? end - cp932.data() : cp932.size();
+
+  FixedText text;
+  memcpy(text.cp932_, cp932.data(), size);
+  text.cp932_size_ = narrow_cast<std::uint8_t>(size);
+  const size_t utf8_size = cp932::to_utf8(
+      multi_span<const char>(text.cp932_, size),
+      multi_span<char>(text.utf8_, capacity));
+  text.utf8_[utf8_size] = '\0';
+  text.utf8_size_ = narrow_cast<std::uint8_t>(utf8_size);
+  return text;
+}
+
+StringPool::handle FixedText::intern(const shared_ptr<StringPool>& pool) {
+  const auto handle = pool->intern(str());
+  interned_id_ = handle.id();
+  return handle;
+}
+
+StringPool::handle FixedText::interned(const StringPool& pool) const {
+  return interned_id_ != not_interned ? pool.at(interned_id_)
+                                      : StringPool::handle();
+}
+
+string FixedText::to_cp932(cp932::unmappable policy) const {
+  if (cp932_size_ != no_cp932) {
+    return string(cp932_, cp932_size_);
+  }
+  return cp932::from_utf8(multi_span<const char>(utf8_, utf8_size_), policy);
+}
+
+size_t FixedText::cp932_size(cp932::unmappable policy) const {
+  if (cp932_size_ != no_cp932) {
+    return cp932_size_;
+  }
+  return cp932::from_utf8_size(multi_span<const char>(utf8_, utf8_size_),
+                               policy);
+}
+
+size_t FixedText::to_cp932(multi_span<char> out,
+                           cp932::unmappable policy) const {
+  if (cp932_size_ != no_cp932) {
+    Expects(out.size() >= cp932_size_);
+    memcpy(out.data(), cp932_, cp932_size_);
+    return cp932_size_;
+  }
+  return cp932::from_utf8(multi_span<const char>(utf8_, utf8_size_), out,
+                          policy);
+}
+
+void FixedText::assign(const char* utf8, size_t size) {
+  if (size > capacity) {
+    throw length_error("Text too long for a fixed string");
+  }
+  memcpy(utf8_, utf8, size);
+  utf8_[size] = '\0';
+  utf8_size_ = narrow_cast<std::uint8_t>(size);
+  cp932_size_ = no_cp932;
+  interned_id_ = not_interned;
+}
+
+bool operator==(const FixedText& lhs, const FixedText& rhs) {
+  return equal(lhs.c_str(), lhs.size(), rhs.c_str(), rhs.size());
+}
+
+bool operator==(const FixedText& lhs, const string& rhs) {
+  return equal(lhs.c_str(), lhs.size(), rhs.data(), rhs.size());
+}
+
+bool operator==(const FixedText& lhs, const char* rhs) {
+  return equal(lhs.c_str(), lhs.size(), rhs, strlen(rhs));
+}
+
+ostream& operator<<(ostream& out, const FixedText& text) {
+  return out.write(text.c_str(), text.size());
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "CP932.hpp"
+#include "SCXFormat.hpp"
+#include "StringPool.hpp"
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <gsl/gsl>
+
+// UTF-8 text from one of the fixed strings, held inline. A fixed string is at
+// most fixed_string_size CP932 bytes, each of which becomes at most three bytes
+// of UTF-8, so the text always fits. Records of them never allocate, and can
+// be copied and moved as plain bytes.
+// The CP932 bytes read are kept too, so text which is not changed round-trips
+// byte for byte without being converted.
+class FixedText {
+ public:
+  static const std::size_t capacity = 3 * fixed_string_size;
+
+  FixedText()
+      : interned_id_(not_interned), utf8_size_(0), cp932_size_(no_cp932) {
+    utf8_[0] = '\0';
+  }
+  // Implicit, so text can be assigned and compared like a std::string. Throws
+  // std::length_error if the text is longer than capacity.
+  FixedText(const std::string& utf8);
+  FixedText(const char* utf8) : FixedText(std::string(utf8)) {}
+
+  // Decodes the CP932 text up to its first null, or its end if it has none
+  static FixedText from_cp932(gsl::multi_span<const char> cp932);
+
+  std::string str() const { return std::string(utf8_, utf8_size_); }
+  operator std::string() const { return str(); }
+  const char* c_str() const { return utf8_; }
+  std::size_t size() const { return utf8_size_; }
+  bool empty() const { return utf8_size_ == 0; }
+
+  // Adds the text to pool, and returns its handle there. The text keeps only
+  // the handle's id, as it copies as plain bytes and so cannot keep the pool
+  // alive.
+  StringPool::handle intern(const std::shared_ptr<StringPool>& pool);
+  // The handle in pool, which must be the one the text was interned in, or a
+  // null handle if the text has not been interned since it was last set
+  StringPool::handle interned(const StringPool& pool) const;
+
+  // The text in CP932. Text which has not been changed is copied as it was
+  // read.
+  std::string to_cp932(cp932::unmappable policy) const;
+  // The size to_cp932 gives, without building it. Text may be too long for a
+  // fixed string once encoded.
+  std::size_t cp932_size(cp932::unmappable policy) const;
+  // As above, into out, which must have room for it. Returns the size written,
+  // which is not null-terminated.
+  std::size_t to_cp932(gsl::multi_span<char> out,
+                       cp932::unmappable policy) const;
+
+ private:
+  // cp932_size_ when there are no CP932 bytes, as the text was set in UTF-8
+  static const std::uint8_t no_cp932 = 0xff;
+  // interned_id_ when the text is not in a pool
+  static const std::uint32_t not_interned = 0xffffffff;
+
+  void assign(const char* utf8, std::size_t size);
+
+  std::uint32_t interned_id_;
+  std::uint8_t utf8_size_;
+  std::uint8_t cp932_size_;
+  char cp932_[fixed_string_size];
+  char utf8_[capacity + 1];
+};
+
+static_assert(std::is_trivially_copyable<FixedText>::value,
+              "FixedText should copy as plain bytes");
+
+bool operator==(const FixedText& lhs, const FixedText& rhs);
+bool operator==(const FixedText& lhs, const std::string& rhs);
+bool operator==(const FixedText& lhs, const char* rhs);
+inline bool operator==(const std::string& lhs, const FixedText& rhs) {
+  return rhs == lhs;
+}
+inline bool operator==(const char* lhs, const FixedText& rhs) {
+  return rhs == lhs;
+}
+
+template <typename T>
+bool operator!=(const FixedText& lhs, const T& rhs) {
+  return !(lhs == rhs);
+}
+inline bool operator!=(const std::string& lhs, const FixedText& rhs) {
+  return !(lhs == rhs);
+}
+inline bool operator!=(const char* lhs, const FixedText& rhs) {
+  return !(lhs == rhs);
+}
+
+std::ostream& operator<<(std::ostream& out, const FixedText& text);
@@ -0,0 +1,212 @@
+#include "LazyText.hpp"
+
+#include <memory>
+using std::shared_ptr;
+#include <ostream>
+using std::ostream;
+#include <string>
+using std::string;
+#include <utility>
+using std::move;
+using std::pair;
+
+#include <cstddef>
+using std::size_t;
+#include <cstring>
+using std::memchr;
+using std::memcmp;
+using std::memcpy;
+using std::strlen;
+
+#include <gsl/gsl>
+using gsl::multi_span;
+
+const size_t LazyText::unbounded;
+
+namespace {
+bool equal(const char* lhs, size_t lhs_size, const char* rhs,
+           size_t rhs_size) {
+  return lhs_size == rhs_size && memcmp(lhs, rhs, lhs_size) == 0;
+}
+}
+
+LazyText LazyText::from_cp932(multi_span<const char> cp932,
+                              shared_ptr<const void> owner) {
+  if (!owner) {
+    return LazyText(cp932::to_utf8(cp932));
+  }
+
+  const auto end =
+      static_cast<const char*>(memchr(cp932.data(), 0, cp932.size()));
+  LazyText text;
+  text.owner_ = move(owner);
+  text.cp932_ = cp932.data();
+  text.cp932_size_ = end != nullptr ? end - cp932.data() : cp932.size();
+  return text;
+}
+
+LazyText LazyText::from_cp932(const char* cp932,
+                              shared_ptr<const TextArena> arena) {
+  Expects(arena && arena->contains(cp932));
+  LazyText text;
+  text.arena_ = arena.get();
+  text.owner_ = move(arena);
+  text.cp932_ = cp932;
+  text.cp932_size_ = unbounded;
+  return text;
+}
+
+const char* LazyText::c_str() const {
+  const char* utf8;
+  size_t utf8_size;
+  view(utf8, utf8_size);
+  return utf8;
+}
+
+size_t LazyText::size() const {
+  const char* utf8;
+  size_t utf8_size;
+  view(utf8, utf8_size);
+  return utf8_size;
+}
+
+void LazyText::decode() const {
+  const char* utf8;
+  size_t utf8_size;
+  if (arena_ != nullptr && arena_->find(cp932_, utf8, utf8_size)) {
+    utf8_.assign(utf8, utf8_size);
+  } else {
+    utf8_ = cp932::to_utf8(multi_span<const char>(cp932_, bounded_size()));
+  }
+  owner_.reset();
+  arena_ = nullptr;
+  cp932_ = nullptr;
+  cp932_size_ = 0;
+}
+
+size_t LazyText::bounded_size() const {
+  if (cp932_size_ == unbounded) {
+    cp932_size_ = arena_->string_at(cp932_).size();
+  }
+  return cp932_size_;
+}
+
+void LazyText::intern(const shared_ptr<StringPool>& pool) {
+  string text;
+  const char* utf8;
+  size_t utf8_size;
+  if (interned_ || cp932_ == nullptr) {
+    text = str();
+  } else if (arena_ != nullptr && arena_->find(cp932_, utf8, utf8_size)) {
+    text.assign(utf8, utf8_size);
+  } else {
+    text = cp932::to_utf8(multi_span<const char>(cp932_, bounded_size()));
+  }
+
+  interned_ = pool->intern(move(text));
+  // The bytes stay in view after the arena is let go
+  if (cp932_ != nullptr) {
+    bounded_size();
+  }
+  owner_ = pool;
+  arena_ = nullptr;
+  utf8_.clear();
+  utf8_.shrink_to_fit();
+}
+
+pair<const void*, size_t> LazyText::source() const {
+  if (cp932_ != nullptr) {
+    return {cp932_, bounded_size()};
+  }
+  if (interned_) {
+    return {interned_.str().data(), interned_.str().size()};
+  }
+  return {nullptr, 0};
+}
+
+void LazyText::view(const char*& utf8, size_t& utf8_size) const {
+  if (interned_) {
+    utf8 = interned_.str().c_str();
+    utf8_size = interned_.str().size();
+    return;
+  }
+  if (arena_ != nullptr && cp932_ != nullptr &&
+      arena_->find(cp932_, utf8, utf8_size)) {
+    return;
+  }
+  utf8 = str().c_str();
+  utf8_size = utf8_.size();
+}
+
+string LazyText::to_cp932(cp932::unmappable policy) const {
+  if (cp932_ != nullptr) {
+    return string(cp932_, bounded_size());
+  }
+  return cp932::from_utf8(multi_span<const char>(str()), policy);
+}
+
+size_t LazyText::cp932_size(cp932::unmappable policy) const {
+  if (cp932_ != nullptr) {
+    return bounded_size();
+  }
+  const char* utf8;
+  size_t utf8_size;
+  view(utf8, utf8_size);
+  return cp932::from_utf8_size(multi_span<const char>(utf8, utf8_size), policy);
+}
+
+size_t LazyText::to_cp932(multi_span<char> out,
+                          cp932::unmappable policy) const {
+  if (cp932_ != nullptr) {
+    const size_t size = bounded_size();
+    Expects(static_cast<size_t>(out.size()) >= size);
+    memcpy(out.data(), cp932_, size);
+    return size;
+  }
+  const char* utf8;
+  size_t utf8_size;
+  view(utf8, utf8_size);
+  return cp932::from_utf8(multi_span<const char>(utf8, utf8_size), out,
+                          policy);
+}
+
+bool operator==(const LazyText& lhs, const LazyText& rhs) {
+  // Text in the same pool is the same only if it is the same entry
+  if (lhs.interned_ && rhs.interned_ && lhs.owner_ == rhs.owner_) {
+    return lhs.interned_ == rhs.interned_;
+  }
+  // The same bytes always decode the same way, so need not be decoded
+  if (lhs.cp932_ != nullptr && rhs.cp932_ != nullptr &&
+      equal(lhs.cp932_, lhs.bounded_size(), rhs.cp932_,
+            rhs.bounded_size())) {
+    return true;
+  }
+  const char* lhs_utf8;
+  size_t lhs_size;
+  lhs.view(lhs_utf8, lhs_size);
+  const char* rhs_utf8;
+  size_t rhs_size;
+  rhs.view(rhs_utf8, rhs_size);
+  return equal(lhs_utf8, lhs_size, rhs_utf8, rhs_size);
+}
+
+bool operator==(const LazyText& lhs, const string& rhs) {
+  const char* utf8;
+  size_t utf8_size;
+  lhs.view(utf8, utf8_size);
+  return equal(utf8, utf8_size, rhs.data(), rhs.size());
+}
+
+bool operator==(const LazyText& lhs, const char* rhs) {
+  const char* utf8;
+  size_t utf8_size;
+  lhs.view(utf8, utf8_size);
+  return equal(utf8, utf8_size, rhs, strlen(rhs));
+}
+
+ostream& operator<<(ostream& out, const LazyText& text) {
+  const char* utf8;
+  size_t utf8_size;
+  text.view(utf8, utf8_size);
+  return out.write(utf8, utf8_size);
+}
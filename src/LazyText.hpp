@@ -0,0 +1,149 @@
+#pragma once
+
+#include "CP932.hpp"
+#include "StringPool.hpp"
+#include "TextArena.hpp"
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <cstddef>
+
+#include <gsl/gsl>
+
+// UTF-8 text which may still be the CP932 bytes it was read from. Those bytes
+// are only decoded when the UTF-8 is first asked for, and the result is kept,
+// so tools which never look at the text never pay to decode it.
+// The bytes are viewed where they are, and whatever holds them is kept alive
+// until the text is decoded or replaced.
+// As the decoded text is cached, a LazyText is not safe to read from more than
+// one thread at a time until it has been decoded.
+class LazyText {
+ public:
+  LazyText()
+      : owner_(),
+        arena_(nullptr),
+        cp932_(nullptr),
+        cp932_size_(0),
+        interned_(),
+        utf8_() {}
+  // Implicit, so text can be assigned and compared like a std::string
+  LazyText(std::string utf8)
+      : owner_(),
+        arena_(nullptr),
+        cp932_(nullptr),
+        cp932_size_(0),
+        interned_(),
+        utf8_(std::move(utf8)) {}
+  LazyText(const char* utf8) : LazyText(std::string(utf8)) {}
+
+  // Views the CP932 text up to its first null, or its end if it has none.
+  // owner must keep the bytes alive. Without an owner the text is decoded
+  // straight away instead.
+  static LazyText from_cp932(gsl::multi_span<const char> cp932,
+                             std::shared_ptr<const void> owner);
+  // As above, for text in the arena's region, which bounds it once the bound
+  // is first needed. The UTF-8 is taken from the arena if a string there
+  // starts with the text.
+  static LazyText from_cp932(const char* cp932,
+                             std::shared_ptr<const TextArena> arena);
+
+  // The text in UTF-8, decoding it if it has not been already
+  const std::string& str() const {
+    if (interned_) {
+      return interned_.str();
+    }
+    if (cp932_ != nullptr) {
+      decode();
+    }
+    return utf8_;
+  }
+  operator const std::string&() const { return str(); }
+  // These take text from an arena where it is, rather than copying it out
+  const char* c_str() const;
+  std::size_t size() const;
+  // Only text which has CP932 bytes needs decoding to answer this, as they
+  // might all be dropped.
+  bool empty() const {
+    return cp932_ != nullptr && !interned_ ? size() == 0 : str().empty();
+  }
+
+  bool decoded() const { return cp932_ == nullptr || interned_; }
+
+  // Where the text is held, when that alone shows it is the same as other
+  // text held there: the CP932 bytes it still views, or its string in a
+  // pool. A null first for text which holds its own copy.
+  std::pair<const void*, std::size_t> source() const;
+
+  // Shares the text with any the same in pool, decoding it if need be. The
+  // pool is kept alive, and must keep alive the CP932 bytes the text was read
+  // from, if it still has them.
+  void intern(const std::shared_ptr<StringPool>& pool);
+  // The text in its pool, or a null handle if it is not in one
+  StringPool::handle interned() const { return interned_; }
+
+  // The text in CP932. Text which has not been decoded is copied as it was
+  // read, so it round-trips byte for byte without being converted.
+  std::string to_cp932(cp932::unmappable policy) const;
+  // The bytes it was read from, which to_cp932 copies, or empty once the
+  // text has been decoded
+  gsl::multi_span<const char> cp932() const {
+    return gsl::multi_span<const char>(
+        cp932_, gsl::narrow_cast<std::ptrdiff_t>(bounded_size()));
+  }
+  // The size to_cp932 gives, without building it
+  std::size_t cp932_size(cp932::unmappable policy) const;
+  // As to_cp932, into out, which needs room for cp932_size bytes. Returns the
+  // size written, which is not null-terminated.
+  std::size_t to_cp932(gsl::multi_span<char> out,
+                       cp932::unmappable policy) const;
+
+ private:
+  friend bool operator==(const LazyText& lhs, const LazyText& rhs);
+  friend bool operator==(const LazyText& lhs, const std::string& rhs);
+  friend bool operator==(const LazyText& lhs, const char* rhs);
+  friend std::ostream& operator<<(std::ostream& out, const LazyText& text);
+
+  void decode() const;
+  // cp932_size_, asking the arena where the text ends if it has not yet
+  std::size_t bounded_size() const;
+  // The UTF-8, without copying it out of an arena
+  void view(const char*& utf8, std::size_t& utf8_size) const;
+
+  // Set until the text is decoded, or the pool once interned
+  mutable std::shared_ptr<const void> owner_;
+  mutable const TextArena* arena_;
+  mutable const char* cp932_;
+  // unbounded until the arena has been asked
+  mutable std::size_t cp932_size_;
+  static const std::size_t unbounded = static_cast<std::size_t>(-1);
+  // Takes the place of utf8_ once interned
+  StringPool::handle interned_;
+
+  mutable std::string utf8_;
+};
+
+bool operator==(const LazyText& lhs, const LazyText& rhs);
+bool operator==(const LazyText& lhs, const std::string& rhs);
+bool operator==(const LazyText& lhs, const char* rhs);
+inline bool operator==(const std::string& lhs, const LazyText& rhs) {
+  return rhs == lhs;
+}
+inline bool operator==(const char* lhs, const LazyText& rhs) {
+  return rhs == lhs;
+}
+
+template <typename T>
+bool operator!=(const LazyText& lhs, const T& rhs) {
+  return !(lhs == rhs);
+}
+inline bool operator!=(const std::string& lhs, const LazyText& rhs) {
+  return !(lhs == rhs);
+}
+inline bool operator!=(const char* lhs, const LazyText& rhs) {
+  return !(lhs == rhs);
+}
+
+std::ostream& operator<<(std::ostream& out, const LazyText& text);
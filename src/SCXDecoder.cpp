@@ -0,0 +1,256 @@
+#include "SCXDecoder.hpp"
+
+#include "Cipher.hpp"
+
+#include <algorithm>
+using std::max;
+using std::min;
+#include <limits>
+using std::numeric_limits;
+#include <memory>
+using std::make_shared;
+#include <utility>
+using std::move;
+
+#include <cstddef>
+using std::size_t;
+#include <cstring>
+using std::memchr;
+using std::memcmp;
+using std::memcpy;
+#include <cstdint>
+using std::uint32_t;
+using std::uint64_t;
+
+#include <gsl/gsl>
+using gsl::byte;
+using gsl::multi_span;
+using gsl::narrow_cast;
+
+SCXDecoder::SCXDecoder(Handler& handler)
+    : handler_(handler),
+      bytes_(),
+      calc_(0),
+      failed_(false),
+      header_(),
+      header_ready_(false),
+      next_(),
+      scene_text_scanned_(0),
+      scene_jumps_(make_shared<SceneJumpPool>()) {}
+
+bool SCXDecoder::feed(multi_span<const byte> chunk) {
+  if (failed_) {
+    return false;
+  }
+
+  const size_t begin = bytes_.size();
+  bytes_.insert(bytes_.end(), chunk.data(), chunk.data() + chunk.size());
+
+  if (begin < 4 && bytes_.size() >= 4 && memcmp(bytes_.data(), "scx\0", 4)) {
+    failed_ = true;
+    return false;
+  }
+
+  // The SCXFileIdentifier is not encrypted
+  const size_t encrypted_begin = max(begin, size_t{SCXFileHeader::offset});
+  if (bytes_.size() > encrypted_begin) {
+    auto fresh = multi_span<byte>(bytes_).subspan(encrypted_begin);
+    calc_ +=
+        cipher::decrypt(fresh, fresh, encrypted_begin - SCXFileHeader::offset);
+  }
+
+  emit_ready();
+  return !failed_;
+}
+
+bool SCXDecoder::finish() {
+  if (failed_ || !header_ready_) {
+    return false;
+  }
+  // The header can only be checked against the size of the whole file
+  if (!header_.fits(bytes_.size())) {
+    return false;
+  }
+  emit_scenes(bytes_.size());
+  if (failed_) {
+    return false;
+  }
+
+  // Voice file names are not stored in this file.
+  for (unsigned s = 0; s < SCXFile::voice_section; ++s) {
+    if (next_[s] < count(static_cast<section>(s))) {
+      return false;
+    }
+  }
+
+  uint32_t checksum;
+  memcpy(&checksum, &bytes_[offsetof(SCXFileIdentifier, checksum)],
+         sizeof(checksum));
+  return calc_ == checksum;
+}
+
+size_t SCXDecoder::count(section s) const {
+  Expects(header_ready_);
+  switch (s) {
+    case SCXFile::scene_section:
+      return header_.scene_count;
+    case SCXFile::table1_section:
+      return header_.counts[SCXFileHeader::table1];
+    case SCXFile::variable_section:
+      return header_.counts[SCXFileHeader::variable];
+    case SCXFile::bg_section:
+      return header_.counts[SCXFileHeader::BG];
+    case SCXFile::chr_section:
+      return header_.counts[SCXFileHeader::CHR];
+    case SCXFile::se_section:
+      return header_.counts[SCXFileHeader::SE];
+    case SCXFile::bgm_section:
+      return header_.counts[SCXFileHeader::BGM];
+    case SCXFile::voice_section:
+      return header_.counts[SCXFileHeader::VOICE];
+    default:
+      return 0;
+  }
+}
+
+void SCXDecoder::emit_ready() {
+  if (!header_ready_) {
+    if (!available(SCXFileHeader::offset, SCXFileHeader::size)) {
+      return;
+    }
+    memcpy(&header_, &bytes_[SCXFileHeader::offset], SCXFileHeader::size);
+    header_ready_ = true;
+    handler_.header(*this);
+  }
+
+  emit_scenes(numeric_limits<uint64_t>::max());
+  emit_table1();
+  emit_variables();
+  emit_assets(SCXFile::bg_section);
+  emit_assets(SCXFile::chr_section);
+  emit_assets(SCXFile::se_section);
+  emit_assets(SCXFile::bgm_section);
+}
+
+void SCXDecoder::emit_scenes(uint64_t file_size) {
+  // The offset table precedes the blobs, so is complete before any blob is
+  const uint64_t scene_blobs_offset = header_.scene_blobs_offset();
+
+  auto& next = next_[SCXFile::scene_section];
+  while (next < header_.scene_count) {
+    const uint64_t blob_offset = scene_blobs_offset + next * Scene::blob_size;
+    if (!available(blob_offset, Scene::blob_size)) {
+      return;
+    }
+
+    uint32_t text_offset;
+    memcpy(&text_offset,
+           &bytes_[SCXFileHeader::scene_string_offsets_offset +
+                   next * sizeof(uint32_t)],
+           sizeof(text_offset));
+
+    multi_span<const char> text;
+    if (text_offset) {
+      if (text_offset < SCXFileHeader::offset || text_offset >= file_size) {
+        failed_ = true;
+        return;
+      }
+      // The text is complete once its null, or the section which follows it,
+      // has arrived
+      const uint64_t end = header_.text_end(text_offset, file_size);
+      const size_t scan_end =
+          narrow_cast<size_t>(min<uint64_t>(end, bytes_.size()));
+      const size_t scan_from = max<size_t>(text_offset, scene_text_scanned_);
+      const auto null =
+          scan_from < scan_end
+              ? static_cast<const byte*>(
+                    memchr(&bytes_[scan_from], 0, scan_end - scan_from))
+              : nullptr;
+      if (null == nullptr && end > bytes_.size()) {
+        scene_text_scanned_ = max(scan_from, scan_end);
+        return;
+      }
+      // Nothing before scan_from was a null, so this one ends the text
+      const byte* text_begin = bytes_.data() + text_offset;
+      text = multi_span<const char>(
+          reinterpret_cast<const char*>(text_begin),
+          (null != nullptr ? null : bytes_.data() + scan_end) - text_begin);
+    }
+
+    Scene scene;
+    scene.read_data(text,
+                    Scene::blob_span(&bytes_[blob_offset], Scene::blob_size),
+                    std::shared_ptr<const void>(), scene_jumps_);
+    handler_.scene(next, move(scene));
+    ++next;
+    scene_text_scanned_ = 0;
+  }
+}
+
+void SCXDecoder::emit_table1() {
+  const uint64_t strings_offset = header_.offsets[SCXFileHeader::table1];
+
+  auto& next = next_[SCXFile::table1_section];
+  while (next < header_.counts[SCXFileHeader::table1]) {
+    const uint64_t string_offset = strings_offset + next * fixed_string_size;
+    if (!available(string_offset, fixed_string_size)) {
+      return;
+    }
+
+    Table1Data table1;
+    table1.read_data(Table1Data::fixed_string_span(&bytes_[string_offset],
+                                                   fixed_string_size));
+    handler_.table1(next, move(table1));
+    ++next;
+  }
+}
+
+void SCXDecoder::emit_variables() {
+  const uint64_t variable_blobs_offset = header_.variable_blobs_offset();
+  const uint64_t strings_offset = header_.offsets[SCXFileHeader::variable];
+
+  auto& next = next_[SCXFile::variable_section];
+  while (next < header_.counts[SCXFileHeader::variable]) {
+    const uint64_t blob_offset =
+        variable_blobs_offset + next * Variable::blob_size;
+    const uint64_t string_offset =
+        strings_offset + next * fixed_string_size * 2;
+    if (!available(blob_offset, Variable::blob_size) ||
+        !available(string_offset, fixed_string_size * 2)) {
+      return;
+    }
+
+    Variable variable;
+    variable.read_data(
+        Variable::fixed_string_span(&bytes_[string_offset], fixed_string_size),
+        Variable::fixed_string_span(&bytes_[string_offset + fixed_string_size],
+                                    fixed_string_size),
+        Variable::blob_span(&bytes_[blob_offset], Variable::blob_size));
+    handler_.variable(next, move(variable));
+    ++next;
+  }
+}
+
+void SCXDecoder::emit_assets(section type) {
+  const auto header_index = static_cast<SCXFileHeader::fixed_strings>(
+      type - SCXFile::bg_section + SCXFileHeader::BG);
+  const uint64_t strings_offset = header_.offsets[header_index];
+
+  auto& next = next_[type];
+  while (next < header_.counts[header_index]) {
+    const uint64_t string_offset =
+        strings_offset + next * fixed_string_size * 2;
+    if (!available(string_offset, fixed_string_size * 2)) {
+      return;
+    }
+
+    AssetName asset;
+    asset.read_data(
+        AssetName::fixed_string_span(&bytes_[string_offset],
+                                     fixed_string_size),
+        AssetName::fixed_string_span(&bytes_[string_offset + fixed_string_size],
+                                     fixed_string_size));
+    handler_.asset(type, next, move(asset));
+    ++next;
+  }
+}
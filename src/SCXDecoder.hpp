@@ -0,0 +1,88 @@
+#pragma once
+
+#include "AssetName.hpp"
+#include "SCXFile.hpp"
+#include "SCXFormat.hpp"
+#include "Scene.hpp"
+#include "SceneJumpPool.hpp"
+#include "Table1Data.hpp"
+#include "Variable.hpp"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <gsl/gsl>
+
+// Decodes an SCX file fed to it in chunks of any size, e.g. from a pipe or an
+// archive reader, rather than from a file on disk. Bytes are decrypted and
+// checksummed as they arrive, and each record is passed to the Handler as soon
+// as all of its bytes have arrived.
+// Records within a section arrive in index order, but the sections are
+// interleaved in whatever order the file lays them out.
+class SCXDecoder {
+ public:
+  using section = SCXFile::section;
+
+  class Handler {
+   public:
+    virtual ~Handler() {}
+
+    // The header has arrived, so decoder.count() can now be called.
+    virtual void header(const SCXDecoder& /*decoder*/) {}
+    virtual void scene(std::size_t /*index*/, Scene&& /*scene*/) {}
+    virtual void table1(std::size_t /*index*/, Table1Data&& /*table1*/) {}
+    virtual void variable(std::size_t /*index*/, Variable&& /*variable*/) {}
+    // type is one of the SCXFile bg, chr, se or bgm sections.
+    // Voice file names are not stored in this file.
+    virtual void asset(section /*type*/, std::size_t /*index*/,
+                       AssetName&& /*asset*/) {}
+  };
+
+  explicit SCXDecoder(Handler& handler);
+
+  // Avoids regrowing the internal buffer, if the total size is known
+  void reserve(std::size_t size) { bytes_.reserve(size); }
+
+  // Returns false once the data cannot be a valid SCX file.
+  bool feed(gsl::multi_span<const gsl::byte> chunk);
+  // Call once all the data has been fed. Returns true if every record arrived
+  // and the checksum matched.
+  bool finish();
+
+  bool header_ready() const { return header_ready_; }
+  std::size_t count(section s) const;
+
+ private:
+  bool available(std::uint64_t offset, std::uint64_t size) const {
+    return offset + size <= bytes_.size();
+  }
+  void emit_ready();
+  // Text which runs to the end of the file is complete only once file_size,
+  // the size of the whole file, is known
+  void emit_scenes(std::uint64_t file_size);
+  void emit_table1();
+  void emit_variables();
+  void emit_assets(section type);
+
+  Handler& handler_;
+
+  // Everything fed so far, decrypted after the SCXFileIdentifier. Offsets in
+  // the file can point backwards, so nothing can be dropped.
+  std::vector<gsl::byte> bytes_;
+  std::uint32_t calc_;
+  bool failed_;
+
+  SCXFileHeader header_;
+  bool header_ready_;
+
+  // The index of the next record to emit in each section
+  std::array<std::size_t, SCXFile::section_count> next_;
+  // How far the next scene's text has been searched for its null or end
+  std::size_t scene_text_scanned_;
+  // Shared by the scenes emitted
+  std::shared_ptr<SceneJumpPool> scene_jumps_;
+};
@@ -1,15 +1,34 @@
 #include "SCXFile.hpp"
 
+#include "Cipher.hpp"
+#include "SCXDecoder.hpp"
+#include "SCXFormat.hpp"
+#include "SCXLayout.hpp"
+#include "SCXView.hpp"
+#include "SceneJumpPool.hpp"
+#include "TextArena.hpp"
+
+#include <algorithm>
+using std::equal_range;
+using std::lower_bound;
+using std::max;
+using std::min;
+using std::sort;
 #include <array>
 using std::array;
 #include <fstream>
 using std::filebuf;
 #include <ios>
 using std::ios_base;
+#include <istream>
+using std::istream;
 #include <memory>
-using std::unique_ptr;
+#include <stdexcept>
+using std::runtime_error;
 #include <string>
 using std::string;
+#include <unordered_map>
+using std::unordered_map;
 #include <utility>
 using std::pair;
 #include <vector>
@@ -17,274 +36,562 @@ using std::vector;
 
 #include <cstddef>
 using std::size_t;
+using std::ptrdiff_t;
 #include <cstring>
+using std::memchr;
 using std::memcmp;
+using std::memcpy;
 #include <cstdint>
-using std::uint8_t;
-using std::int8_t;
 using std::uint32_t;
+using std::uint64_t;
 
 #include <gsl/gsl>
+using gsl::as_bytes;
 using gsl::as_multi_span;
+using gsl::as_writeable_bytes;
 using gsl::byte;
-using gsl::dim;
-using gsl::dynamic_range;
 using gsl::narrow_cast;
 using gsl::multi_span;
 
+#include <boost/container/pmr/memory_resource.hpp>
+#include <boost/container/pmr/monotonic_buffer_resource.hpp>
+using boost::container::pmr::memory_resource;
+using boost::container::pmr::monotonic_buffer_resource;
+#include <boost/filesystem.hpp>
+using boost::filesystem::path;
+using boost::filesystem::remove;
+using boost::filesystem::rename;
+using boost::filesystem::unique_path;
+#include <boost/interprocess/exceptions.hpp>
 #include <boost/interprocess/file_mapping.hpp>
 #include <boost/interprocess/mapped_region.hpp>
 using namespace boost::interprocess;
 
 namespace {
 
-// All data is little-endian
-// Not encrypted
-struct SCXFileIdentifier {
-  const static size_t size = 0x08;
-  const static size_t offset = 0x0;
+// Views of the sections of an image, see SCXLayout
+using scene_blobs_view = record_view<const byte, Scene::blob_size>;
+using scene_blobs_writeable_view = record_view<byte, Scene::blob_size>;
+using variable_blobs_view = record_view<const byte, Variable::blob_size>;
+using variable_blobs_writeable_view = record_view<byte, Variable::blob_size>;
+using fixed_strings_view = record_view<const byte, fixed_string_size>;
+using fixed_strings_writeable_view = record_view<byte, fixed_string_size>;
+
+// Calls add with the index of each scene and the scene. Offsets are into
+// image, and have been checked to lie within it. Text in text_arena is bounded
+// by the arena, and any other text by text_end, which gives the end of the
+// section an offset lies in.
+// Scenes with the same offset share its text, which is then decoded once.
+template <typename Add, typename TextEnd>
+void read_scene_data(Add add, scene_blobs_view scene_blobs,
+                     value_view<const uint32_t> scene_string_offsets,
+                     const char* image, TextEnd text_end,
+                     const std::shared_ptr<const void>& owner,
+                     const std::shared_ptr<const TextArena>& text_arena) {
+  Expects(scene_blobs.size() == scene_string_offsets.size());
+  const auto jumps = std::make_shared<SceneJumpPool>();
+
+  vector<uint32_t> sorted_offsets(scene_string_offsets.size());
+  for (size_t i = 0; i < sorted_offsets.size(); ++i) {
+    sorted_offsets[i] = scene_string_offsets[i];
+  }
+  sort(sorted_offsets.begin(), sorted_offsets.end());
+  auto repeated = [&sorted_offsets](uint32_t offset) {
+    const auto found = equal_range(sorted_offsets.cbegin(),
+                                   sorted_offsets.cend(), offset);
+    return found.second - found.first > 1;
+  };
+  // The text of the first scene with each repeated offset
+  unordered_map<uint32_t, LazyText> shared_text;
+
+  auto bounded_text = [image, &text_end,
+                       &text_arena](uint32_t offset) -> multi_span<const char> {
+    const char* text = image + offset;
+    if (text_arena->contains(text)) {
+      return text_arena->string_at(text);
+    }
+    const size_t limit = text_end(offset) - offset;
+    const auto null = static_cast<const char*>(memchr(text, 0, limit));
+    return multi_span<const char>(
+        text, narrow_cast<ptrdiff_t>(null != nullptr ? null - text : limit));
+  };
 
-  char fileprefix[4];  // "scx\0"
-  uint32_t checksum;
-};
+  for (size_t i = 0; i < scene_blobs.size(); ++i) {
+    Scene scene;
+    const auto blob = scene_blobs[i];
+    const auto offset = scene_string_offsets[i];
+    const char* text = image + offset;
+    const bool shared = offset != 0 && repeated(offset);
+    const auto found = shared ? shared_text.find(offset) : shared_text.end();
+    if (offset == 0) {
+      scene.read_data(nullptr, blob, owner, jumps);
+    } else if (found != shared_text.end()) {
+      scene.read_data(nullptr, blob, owner, jumps);
+      scene.text = found->second;
+    } else if (shared && !text_arena->starts_string(text)) {
+      // Text the arena cannot give the UTF-8 of gets an arena of its own, so
+      // the scenes sharing it still decode it once
+      const auto own_text = bounded_text(offset);
+      scene.read_data(own_text.data(), blob,
+                      std::make_shared<const TextArena>(own_text, owner),
+                      jumps);
+    } else if (text_arena->contains(text)) {
+      scene.read_data(text, blob, text_arena, jumps);
+    } else {
+      scene.read_data(bounded_text(offset), blob, owner, jumps);
+    }
+    if (shared && found == shared_text.end()) {
+      shared_text.emplace(offset, scene.text);
+    }
+    add(i, std::move(scene));
+  }
+}
 
-static_assert(sizeof(SCXFileIdentifier) == SCXFileIdentifier::size,
-              "SCXFileIdentifier did not pack correctly");
-
-// All following data is encrypted
-struct SCXFileHeader {
-  const static size_t size = 0x3c;
-  const static size_t offset = 0x08;
-
-  enum fixed_strings : size_t {
-    table1,
-    variable,
-    BG,
-    CHR,
-    SE,
-    BGM,
-    VOICE,
-    COUNT,
-  };
+// For each scene, the first scene whose text is known to be the same without
+// looking at it, see LazyText::source. Such text is only written once.
+vector<size_t> first_with_same_text(const record_vector<Scene>& scenes) {
+  vector<pair<pair<const void*, size_t>, size_t>> sources;
+  sources.reserve(scenes.size());
+  for (size_t i = 0; i < scenes.size(); ++i) {
+    const auto source = scenes[i].text.source();
+    if (source.first != nullptr) {
+      sources.emplace_back(source, i);
+    }
+  }
+  sort(sources.begin(), sources.end());
 
-  uint32_t scene_count;
-  std::array<uint32_t, COUNT> counts;
-  std::array<uint32_t, COUNT> offsets;
-};
+  vector<size_t> first(scenes.size());
+  for (size_t i = 0; i < first.size(); ++i) {
+    first[i] = i;
+  }
+  for (size_t i = 1; i < sources.size(); ++i) {
+    if (sources[i].first == sources[i - 1].first) {
+      first[sources[i].second] = first[sources[i - 1].second];
+    }
+  }
+  return first;
+}
 
-static_assert(sizeof(SCXFileHeader) == SCXFileHeader::size,
-              "SCXFileHeader did not pack correctly");
-
-using scene_blobs_span =
-    multi_span<const byte, dynamic_range, Scene::blob_size>;
-
-void read_scene_data(vector<Scene>& scene_data, scene_blobs_span scene_blobs,
-                     multi_span<const uint32_t> scene_string_offsets,
-                     multi_span<const byte> buffer) {
-  Expects(scene_blobs.extent() == scene_string_offsets.extent());
-  scene_data.resize(scene_blobs.extent());
-  for (size_t i = 0; i < scene_data.size(); ++i) {
-    auto& scene = scene_data[i];
-    const auto& blob = scene_blobs[i];
-    auto offset = scene_string_offsets[i];
-    // XXX: This breaks if buffer[offset] does not point to a null-terminated
-    // string!
-    auto pString =
-        offset ? &as_multi_span<const char>(buffer).data()[offset] : nullptr;
-    scene.read_data(pString, blob);
-  }
-}
-
-using scene_blobs_writeable_span =
-    multi_span<byte, dynamic_range, Scene::blob_size>;
-using scene_storage_data =
-    vector<pair<array<byte, Scene::blob_size>, unique_ptr<string>>>;
-
-void write_scene_data(const scene_storage_data& scene_data,
-                      scene_blobs_writeable_span scene_blobs,
-                      multi_span<uint32_t> scene_text_offsets,
+// Encodes each scene's text straight into scene_text_storage, which must be
+// the size the text was found to be by LazyText::cp932_size, counting only
+// the scenes which are their own first_with_same_text. Text already in
+// cp932_texts, if that is not empty, is copied from there instead.
+void write_scene_data(const record_vector<Scene>& scenes,
+                      const vector<size_t>& first_with_text,
+                      const vector<multi_span<const char>>& cp932_texts,
+                      scene_blobs_writeable_view scene_blobs,
+                      value_view<uint32_t> scene_text_offsets,
                       multi_span<byte> scene_text_storage,
-                      uint32_t base_offset) {
-  Expects(scene_data.size() == scene_blobs.extent());
-  Expects(scene_data.size() == scene_text_offsets.extent());
-  for (size_t i = 0; i < scene_data.size(); ++i) {
-    auto blob = scene_blobs[i];
+                      uint32_t base_offset, cp932::unmappable policy) {
+  Expects(scenes.size() == scene_blobs.size());
+  Expects(scenes.size() == scene_text_offsets.size());
+  char* text = as_multi_span<char>(scene_text_storage).data();
+  size_t text_left = scene_text_storage.size_bytes();
+  for (size_t i = 0; i < scenes.size(); ++i) {
+    const auto& scene = scenes[i];
     auto& offset = scene_text_offsets[i];
-    auto& data = scene_data[i];
-    memcpy(blob.data(), data.first.data(), Scene::blob_size);
-    if (!data.second) {
+    scene.write_data(scene_blobs[i]);
+    if (first_with_text[i] != i) {
+      offset = scene_text_offsets[first_with_text[i]];
+      continue;
+    }
+    size_t text_size;
+    if (cp932_texts.empty()) {
+      text_size = scene.text.to_cp932(
+          multi_span<char>(text, narrow_cast<ptrdiff_t>(text_left)), policy);
+    } else {
+      const auto cp932 = cp932_texts[i];
+      text_size = static_cast<size_t>(cp932.size());
+      Expects(text_left >= text_size);
+      memcpy(text, cp932.data(), text_size);
+    }
+    if (text_size == 0) {
       offset = 0;
       continue;
     }
-    auto& text = *data.second;
-    uint32_t buffSize = narrow_cast<uint32_t>(text.size() + 1);
-    assert(scene_text_storage.size_bytes() >= buffSize);
-    memcpy(scene_text_storage.data(), text.c_str(), buffSize);
+    uint32_t buffSize = narrow_cast<uint32_t>(text_size + 1);
+    assert(text_left >= buffSize);
+    text[text_size] = '\0';
     offset = base_offset;
     base_offset += buffSize;
-    scene_text_storage = scene_text_storage.subspan(buffSize);
+    text += buffSize;
+    text_left -= buffSize;
+  }
+  Ensures(text_left == 0);
+}
+
+// Multiplies and shifts in a word at a time. Only the size and the ends of
+// longer text are hashed, as text which hashes the same is compared anyway.
+uint64_t hash_bytes(const char* data, size_t size) {
+  const uint64_t multiplier = 0xff51afd7ed558ccd;
+  const size_t end_size = 32;
+  uint64_t hash = size * multiplier;
+  auto add = [&hash, multiplier](const char* bytes, size_t count) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= count; i += sizeof(uint64_t)) {
+      uint64_t word;
+      memcpy(&word, bytes + i, sizeof(word));
+      hash = (hash ^ word) * multiplier;
+      hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + i, count - i);
+    hash = (hash ^ tail) * multiplier;
+  };
+  if (size <= 2 * end_size) {
+    add(data, size);
+  } else {
+    add(data, end_size);
+    add(data + size - end_size, end_size);
   }
-  Ensures(scene_text_storage.size_bytes() == 0);
+  return hash ^ (hash >> 29);
 }
 
-static const uint32_t fixed_string_size = 0x20;
-using fixed_strings_span =
-    multi_span<const byte, dynamic_range, fixed_string_size>;
+// As first_with_same_text, but looking at the text: each scene's CP932 is
+// hashed, and compared with any text it might be the same as. Text which has
+// been decoded is encoded again into encoded to compare it, the rest is
+// compared where it was read from. Either way cp932_texts is left with the
+// CP932 of each first scene, for write_scene_data to copy.
+vector<size_t> first_with_same_cp932(
+    const record_vector<Scene>& scenes, const vector<size_t>& first_with_text,
+    cp932::unmappable policy, vector<char>& encoded,
+    vector<multi_span<const char>>& cp932_texts) {
+  vector<size_t> first(first_with_text);
+  cp932_texts.assign(scenes.size(), multi_span<const char>());
+
+  size_t encoded_size = 0;
+  for (size_t i = 0; i < scenes.size(); ++i) {
+    if (first[i] == i && scenes[i].text.cp932().empty()) {
+      encoded_size += scenes[i].text.cp932_size(policy);
+    }
+  }
+  // Sized first, so the text in it stays where it is
+  encoded.assign(encoded_size, '\0');
+  size_t encoded_used = 0;
+
+  // The first scene with each text, in an open-addressed table at least
+  // twice the size of the most there can be
+  struct entry {
+    const char* data;
+    uint32_t size;
+    uint32_t scene;
+  };
+  size_t table_size = 16;
+  while (table_size < 2 * scenes.size()) {
+    table_size *= 2;
+  }
+  vector<entry> table(table_size, entry{nullptr, 0, 0});
 
-void read_table1_data(vector<Table1Data>& table1_data,
-                      fixed_strings_span table1_strings) {
-  table1_data.resize(table1_strings.extent());
+  for (size_t i = 0; i < scenes.size(); ++i) {
+    if (first[i] != i) {
+      // Which comes before, so has been looked up already
+      first[i] = first[first[i]];
+      continue;
+    }
+    const auto& text = scenes[i].text;
+    auto cp932 = text.cp932();
+    if (cp932.empty()) {
+      const size_t size = text.cp932_size(policy);
+      if (size == 0) {
+        continue;
+      }
+      char* out = encoded.data() + encoded_used;
+      const auto written = text.to_cp932(
+          multi_span<char>(out, narrow_cast<ptrdiff_t>(size)), policy);
+      encoded_used += written;
+      cp932 = multi_span<const char>(out, narrow_cast<ptrdiff_t>(written));
+    }
+    cp932_texts[i] = cp932;
+
+    const size_t size = cp932.size();
+    for (size_t slot = hash_bytes(cp932.data(), size);; ++slot) {
+      auto& found = table[slot & (table.size() - 1)];
+      if (found.data == nullptr) {
+        found = entry{cp932.data(), narrow_cast<uint32_t>(size),
+                      narrow_cast<uint32_t>(i)};
+        break;
+      }
+      if (found.size == size && memcmp(found.data, cp932.data(), size) == 0) {
+        first[i] = found.scene;
+        break;
+      }
+    }
+  }
+  return first;
+}
+
+void read_table1_data(record_vector<Table1Data>& table1_data,
+                      fixed_strings_view table1_strings) {
+  table1_data.resize(table1_strings.size());
   for (size_t i = 0; i < table1_data.size(); ++i) {
     auto& table1_entry = table1_data[i];
     table1_entry.read_data(table1_strings[i]);
   }
 }
 
-using fixed_strings_writeable_span =
-    multi_span<byte, dynamic_range, fixed_string_size>;
-
-void write_table1_data(const vector<Table1Data>& table1_data,
-                       fixed_strings_writeable_span table1_strings) {
-  Expects(table1_data.size() == table1_strings.extent());
+void write_table1_data(const record_vector<Table1Data>& table1_data,
+                       fixed_strings_writeable_view table1_strings,
+                       cp932::unmappable policy) {
+  Expects(table1_data.size() == table1_strings.size());
   for (size_t i = 0; i < table1_data.size(); ++i) {
     const auto& table1_entry = table1_data[i];
-    table1_entry.write_data(table1_strings[i]);
+    table1_entry.write_data(table1_strings[i], policy);
   }
 }
 
-using variable_blobs_span =
-    multi_span<const byte, dynamic_range, Variable::blob_size>;
-using fixed_string_pairs_span =
-    multi_span<const byte, dynamic_range, 2, fixed_string_size>;
+// Fixed strings come in pairs from here on, so a record's are 2i and 2i + 1
 
-void read_variable_data(vector<Variable>& variable_data,
-                        variable_blobs_span variable_blobs,
-                        fixed_string_pairs_span variable_strings_buffers) {
-  Expects(variable_blobs.extent() == variable_strings_buffers.extent());
-  variable_data.resize(variable_blobs.extent());
+void read_variable_data(record_vector<Variable>& variable_data,
+                        variable_blobs_view variable_blobs,
+                        fixed_strings_view variable_strings) {
+  Expects(variable_blobs.size() * 2 == variable_strings.size());
+  variable_data.resize(variable_blobs.size());
   for (size_t i = 0; i < variable_data.size(); ++i) {
     auto& variable = variable_data[i];
-    auto strings = variable_strings_buffers[i];
-    variable.read_data(strings[0], strings[1], variable_blobs[i]);
-  }
-}
-
-using variable_blobs_writeable_span =
-    multi_span<byte, dynamic_range, Variable::blob_size>;
-using fixed_string_pairs_writeable_span =
-    multi_span<byte, dynamic_range, 2, fixed_string_size>;
-
-void write_variable_data(
-    const vector<Variable>& variable_data,
-    variable_blobs_writeable_span variable_blobs,
-    fixed_string_pairs_writeable_span variable_strings_buffers) {
-  Expects(variable_data.size() == variable_blobs.extent());
-  Expects(variable_data.size() == variable_strings_buffers.extent());
-  size_t index = 0;
-  for (const auto& variable : variable_data) {
-    auto blob = variable_blobs[index];
-    // sunspan always returns a single-dimensional span...
-    // variable_blobs = variable_blobs.subspan(1);
-    auto strings = variable_strings_buffers[index];
-    // variable_strings_buffers = variable_strings_buffers.subspan(1);
-    variable.write_data(strings[0], strings[1], blob);
-    ++index;
-  }
-  Ensures(variable_blobs.extent() == index);
-  Ensures(variable_strings_buffers.extent() == index);
-}
-
-void read_asset_strings(vector<AssetName>& asset_data,
-                        fixed_string_pairs_span asset_strings_buffers) {
-  asset_data.resize(asset_strings_buffers.extent());
+    variable.read_data(variable_strings[2 * i], variable_strings[2 * i + 1],
+                       variable_blobs[i]);
+  }
+}
+
+void write_variable_data(const record_vector<Variable>& variable_data,
+                         variable_blobs_writeable_view variable_blobs,
+                         fixed_strings_writeable_view variable_strings,
+                         cp932::unmappable policy) {
+  Expects(variable_data.size() == variable_blobs.size());
+  Expects(variable_data.size() * 2 == variable_strings.size());
+  for (size_t i = 0; i < variable_data.size(); ++i) {
+    const auto& variable = variable_data[i];
+    variable.write_data(variable_strings[2 * i], variable_strings[2 * i + 1],
+                        variable_blobs[i], policy);
+  }
+}
+
+void read_asset_strings(record_vector<AssetName>& asset_data,
+                        fixed_strings_view asset_strings) {
+  asset_data.resize(asset_strings.size() / 2);
   for (size_t i = 0; i < asset_data.size(); ++i) {
     auto& asset = asset_data[i];
-    auto strings = asset_strings_buffers[i];
-    asset.read_data(strings[0], strings[1]);
+    asset.read_data(asset_strings[2 * i], asset_strings[2 * i + 1]);
   }
 }
 
-void write_asset_strings(
-    const vector<AssetName>& asset_data,
-    fixed_string_pairs_writeable_span asset_strings_buffers) {
-  Expects(asset_data.size() == asset_strings_buffers.extent());
-  size_t index = 0;
-  for (const auto& asset : asset_data) {
-    auto strings = asset_strings_buffers[index];
-    asset.write_data(strings[0], strings[1]);
-    ++index;
+void write_asset_strings(const record_vector<AssetName>& asset_data,
+                         fixed_strings_writeable_view asset_strings,
+                         cp932::unmappable policy) {
+  Expects(asset_data.size() * 2 == asset_strings.size());
+  for (size_t i = 0; i < asset_data.size(); ++i) {
+    const auto& asset = asset_data[i];
+    asset.write_data(asset_strings[2 * i], asset_strings[2 * i + 1], policy);
   }
-  Ensures(asset_strings_buffers.extent() == index);
 }
 
-// 0x535f5c in the avking.exe image
-static const array<uint8_t, 11> ENCRYPTION_KEY{
-    0xa9, 0xb3, 0xf2, 0x87, 0xdc, 0xaf, 0x13, 0x67, 0xd5, 0x91, 0xec};
+// The section described by the header field at offset field, see
+// SCXFileHeader::misfit
+SCXFile::section misfit_section(size_t field) {
+  if (field == SCXFileHeader::scene_count_field) {
+    return SCXFile::scene_section;
+  }
+  // The counts, then the offsets, of the fixed-string sections, which follow
+  // the scenes in the same order in SCXFile::section
+  const size_t index =
+      (field - SCXFileHeader::count_field(SCXFileHeader::table1)) /
+      sizeof(uint32_t) % SCXFileHeader::COUNT;
+  return static_cast<SCXFile::section>(SCXFile::table1_section + index);
+}
 
-// The offset is within the encrypted region
-uint8_t xor_key(ptrdiff_t offset) {
-  uint8_t key = ENCRYPTION_KEY[offset % ENCRYPTION_KEY.size()];
-  // Wrapping is expected here.
-  return key + static_cast<uint8_t>(offset);
+// Where a section's records start in the file
+size_t section_offset(const SCXLayout& layout, SCXFile::section s) {
+  if (s == SCXFile::scene_section) {
+    return SCXFileHeader::scene_string_offsets_offset;
+  }
+  // The fixed-string sections, in the same order as in SCXFileHeader
+  return layout.strings_offset(
+      static_cast<SCXFileHeader::fixed_strings>(s - SCXFile::table1_section));
 }
 }
 
+struct SCXFile::Image {
+  Image(const string& fileName, unsigned threads)
+      : region(file_mapping(fileName.c_str(), read_only), copy_on_write),
+        bytes(reinterpret_cast<byte*>(region.get_address()),
+              narrow_cast<ptrdiff_t>(region.get_size())),
+        threads(threads) {}
+
+  // Decrypts [begin, end) of the file, skipping anything already decrypted.
+  // Returns the checksum of the bytes it decrypted.
+  uint32_t decrypt(size_t begin, size_t end);
+  // The checksum of the whole encrypted region, as it was in the file
+  uint32_t checksum() const;
+
+  // Scene text has no section of its own, so runs up to whatever is next
+  size_t text_end(size_t offset) const { return layout.text_end(offset); }
+
+  // Private pages, so the image can be decrypted in place without a copy and
+  // without touching the file.
+  mapped_region region;
+  multi_span<byte> bytes;
+  unsigned threads;
+
+  uint32_t expected_checksum;
+  SCXLayout layout;
+
+  // Sorted, non-overlapping [begin, end) ranges already decrypted
+  vector<pair<size_t, size_t>> decrypted;
+};
+
+uint32_t SCXFile::Image::decrypt(size_t begin, size_t end) {
+  if (begin == end) {
+    return 0;
+  }
+  Expects(begin >= SCXFileHeader::offset && begin < end &&
+          end <= static_cast<size_t>(bytes.size()));
+
+  // The first range which ends at or after begin
+  auto first = lower_bound(
+      decrypted.begin(), decrypted.end(), begin,
+      [](const pair<size_t, size_t>& range, size_t value) {
+        return range.second < value;
+      });
+  if (first != decrypted.end() && first->first <= begin &&
+      first->second >= end) {
+    return 0;
+  }
+
+  // Decrypt the gaps between any ranges touching [begin, end), and merge them
+  uint32_t calc = 0;
+  auto decrypt_gap = [this, &calc](size_t gap_begin, size_t gap_end) {
+    auto gap = bytes.subspan(gap_begin, gap_end - gap_begin);
+    calc += cipher::decrypt(gap, gap, gap_begin - SCXFileHeader::offset,
+                            threads);
+  };
+  size_t position = begin;
+  size_t merged_begin = begin;
+  size_t merged_end = end;
+  auto last = first;
+  for (; last != decrypted.end() && last->first <= end; ++last) {
+    if (last->first > position) {
+      decrypt_gap(position, last->first);
+    }
+    position = max(position, last->second);
+    merged_begin = min(merged_begin, last->first);
+    merged_end = max(merged_end, last->second);
+  }
+  if (position < end) {
+    decrypt_gap(position, end);
+  }
+
+  first = decrypted.erase(first, last);
+  decrypted.emplace(first, merged_begin, merged_end);
+  return calc;
+}
+
+uint32_t SCXFile::Image::checksum() const {
+  // Anything already decrypted is encrypted again into scratch space, to
+  // checksum what was in the file.
+  vector<byte> scratch(0x10000);
+  uint32_t calc = 0;
+  size_t position = SCXFileHeader::offset;
+  for (const auto& range : decrypted) {
+    calc += cipher::checksum(bytes.subspan(position, range.first - position));
+    for (position = range.first; position < range.second;
+         position += scratch.size()) {
+      const auto length = min(scratch.size(), range.second - position);
+      calc += cipher::encrypt(bytes.subspan(position, length),
+                              multi_span<byte>(scratch).first(length),
+                              position - SCXFileHeader::offset);
+    }
+    position = range.second;
+  }
+  return calc + cipher::checksum(bytes.subspan(position));
+}
+
+const AssetName SCXFile::unnamed_voice;
+
 SCXFile::SCXFile()
-    : scenes_(),
+    : resource_(),
+      caller_resource_(nullptr),
+      scenes_(),
       variables_(),
       table1_(),
       bg_names_(),
       chr_names_(),
       se_names_(),
       bgm_names_(),
-      voice_names_() {}
-
-/* Structure:
-4 bytes scx\0  - Not encrypted
-4 byte checksum  - Not encrypted, checksum of encrypted data
-// Everything below here is XOR'd against:
-//  0xa9 0xb3 0xf2 0x87 0xdc 0xaf 0x13 0x67 0xd5 0x91 0xec
-0x08: uint32 scene_count (16913)
-0x0c: uint32 table1_count (474)
-0x10: uint32 variable_count (781)
-0x14: uint32 BG_count
-0x18: uint32 CHR_count
-0x1c: uint32 SE_count
-0x20: uint32 BGM_count
-0x24: uint32 VOICE_count
-0x28: uint32 table1_strings_offset
-0x2c: uint32 variable_names_offset
-Asset names:
-0x30: uint32 BG_names_offset
-0x34: uint32 CHR_names_offset
-0x38: uint32 SE_names_offset
-0x3c: uint32 BGM_names_offset
-0x40: uint32 VOICE_names_offset
-STRING OFFSETS:
-0x44: scene_count * uint32 string offsets (may be 0 - no string)
-BLOBS: following the scene offsets
-....: scene_count * 0xd8 scene info blobs
-....: variable_count * 0xc variable info blobs
-STRINGS: Offsets read from header
-....: table1 strings (0x20 byte fixed string buffer, stops at first null)
-....: variable string-pairs (0x20 byte fixed string buffer, stops at first null,
-x2)
-  Looks like comment then description.
-....: Asset name string-pairs (0x20 byte fixed string buffer, stops at first
-null, x2)
-  Looks like name then display-name?
-*/
-
-bool SCXFile::read(const string& fileName) try {
-  file_mapping file(fileName.c_str(), read_only);
-  mapped_region region(file, read_only);
-  void* addr = region.get_address();
-  size_t size = region.get_size();
+      voice_count_(0),
+      image_(),
+      pending_(0),
+      threads_(1),
+      unmappable_(cp932::unmappable::skip),
+      interning_(false),
+      pool_(),
+      deduplicating_(false) {}
+
+SCXFile::SCXFile(memory_resource* resource) : SCXFile() {
+  caller_resource_ = resource;
+}
+
+void SCXFile::swap(SCXFile& other) noexcept {
+  using std::swap;
+  swap(resource_, other.resource_);
+  swap(caller_resource_, other.caller_resource_);
+  swap(scenes_, other.scenes_);
+  swap(table1_, other.table1_);
+  swap(variables_, other.variables_);
+  swap(bg_names_, other.bg_names_);
+  swap(chr_names_, other.chr_names_);
+  swap(se_names_, other.se_names_);
+  swap(bgm_names_, other.bgm_names_);
+  swap(voice_count_, other.voice_count_);
+  swap(image_, other.image_);
+  swap(pending_, other.pending_);
+  swap(threads_, other.threads_);
+  swap(unmappable_, other.unmappable_);
+  swap(interning_, other.interning_);
+  swap(pool_, other.pool_);
+  swap(deduplicating_, other.deduplicating_);
+}
+
+SCXFile SCXFile::fresh() const {
+  SCXFile file(caller_resource_);
+  // The caller's resource is not owned, so is only aliased
+  file.resource_ =
+      caller_resource_ != nullptr
+          ? std::shared_ptr<memory_resource>(std::shared_ptr<void>(),
+                                             caller_resource_)
+          : std::make_shared<monotonic_buffer_resource>();
+  const record_allocator<Scene> allocator(file.resource_.get());
+  file.scenes_ = record_vector<Scene>(allocator);
+  file.table1_ = record_vector<Table1Data>(allocator);
+  file.variables_ = record_vector<Variable>(allocator);
+  file.bg_names_ = record_vector<AssetName>(allocator);
+  file.chr_names_ = record_vector<AssetName>(allocator);
+  file.se_names_ = record_vector<AssetName>(allocator);
+  file.bgm_names_ = record_vector<AssetName>(allocator);
+  file.threads_ = threads_;
+  file.unmappable_ = unmappable_;
+  file.interning_ = interning_;
+  file.deduplicating_ = deduplicating_;
+  return file;
+}
 
-  vector<byte> storage(reinterpret_cast<byte*>(addr),
-                       reinterpret_cast<byte*>(addr) + size);
+bool SCXFile::read(const string& fileName, load_mode mode) {
+  return static_cast<bool>(parse(fileName, mode));
+}
 
-  multi_span<const byte> buffer(storage);
+SCXFile::read_result SCXFile::parse(const string& fileName,
+                                    load_mode mode) noexcept try {
+  std::shared_ptr<Image> image;
+  try {
+    image = std::make_shared<Image>(fileName, threads_);
+  } catch (const interprocess_exception&) {
+    return read_result{verify_status::unreadable, section_count, 0};
+  }
+  multi_span<const byte> buffer(image->bytes);
+  if (static_cast<size_t>(buffer.size_bytes()) <
+      SCXFileHeader::offset + SCXFileHeader::size) {
+    return read_result{verify_status::truncated, section_count,
+                       narrow_cast<uint64_t>(buffer.size_bytes())};
+  }
 
   // Extract and advance past an SCXFileIdentifier
   const auto& ident = as_multi_span<SCXFileIdentifier>(
@@ -292,97 +599,538 @@ bool SCXFile::read(const string& fileName) try {
   buffer = buffer.subspan(sizeof(SCXFileIdentifier));
 
   if (memcmp(&ident.fileprefix, "scx\0", 4)) {
-    return false;
+    return read_result{verify_status::bad_prefix, section_count,
+                       SCXFileIdentifier::offset};
+  }
+  image->expected_checksum = ident.checksum;
+
+  if (mode == load_mode::eager) {
+    // Routine at 0x4352a0 in the binary does the checksum and decrypting
+    uint32_t calc = image->decrypt(SCXFileHeader::offset, image->bytes.size());
+    if (calc != ident.checksum) {
+      return read_result{verify_status::bad_checksum, section_count,
+                         offsetof(SCXFileIdentifier, checksum)};
+    }
+  } else {
+    image->decrypt(SCXFileHeader::offset,
+                   SCXFileHeader::offset + SCXFileHeader::size);
   }
 
-  // Routine at 0x4352a0 in the binary does the checksum and decrypting
-  auto encrypted = multi_span<byte>(storage).subspan(sizeof(SCXFileIdentifier));
-  uint32_t calc = 0;
-  for (ptrdiff_t i = 0; i < encrypted.extent(); ++i) {
-    // Checksum: Signed math
-    calc += static_cast<int8_t>(encrypted[i]);
-    // Decrypt: Unsigned math
-    reinterpret_cast<uint8_t&>(encrypted[i]) ^= xor_key(i);
+  // Extract an SCXFileHeader, and check everything it describes is in the
+  // file before anything is decoded
+  const auto& header =
+      as_multi_span<SCXFileHeader>(buffer.first<sizeof(SCXFileHeader)>())[0];
+  const size_t misfit = header.misfit(image->bytes.size());
+  if (misfit != 0) {
+    return read_result{verify_status::bad_section, misfit_section(misfit),
+                       misfit};
+  }
+  auto& layout = image->layout;
+  layout.locate(header, image->bytes.size());
+
+  image->decrypt(SCXFileHeader::scene_string_offsets_offset,
+                 layout.scene_blobs_offset());
+  const auto scene_string_offsets =
+      layout.scene_text_offsets(multi_span<const byte>(image->bytes));
+  const size_t misplaced =
+      SCXFileHeader::misplaced_text(scene_string_offsets, layout.file_size());
+  if (misplaced != scene_string_offsets.size()) {
+    return read_result{verify_status::bad_scene_text, scene_section,
+                       SCXFileHeader::text_offset_field(misplaced)};
+  }
+
+  // Decode into a fresh SCXFile, so a failure leaves this one untouched
+  SCXFile loaded = fresh();
+  loaded.image_ = image;
+  loaded.pending_ = (1u << section_count) - 1;
+  if (interning_) {
+    loaded.pool_ = std::make_shared<StringPool>(image);
+  }
+
+  if (mode == load_mode::eager) {
+    for (unsigned s = 0; s < section_count; ++s) {
+      // A CP932 converter other than the builtin one can fail
+      try {
+        loaded.load(static_cast<section>(s));
+      } catch (const runtime_error&) {
+        return read_result{verify_status::undecodable, static_cast<section>(s),
+                           section_offset(layout, static_cast<section>(s))};
+      }
+    }
+    loaded.image_.reset();
+  }
+
+  swap(loaded);
+  return read_result{verify_status::ok, section_count, 0};
+} catch (...) {
+  // Running out of memory, as everything else is caught where it is thrown
+  return read_result{verify_status::unreadable, section_count, 0};
+}
+
+class SCXFile::StreamBuilder : public SCXDecoder::Handler {
+ public:
+  explicit StreamBuilder(SCXFile& file) : file_(file) {}
+
+  // The header's counts are not checked against anything until the stream
+  // ends, so the records are appended as they arrive rather than allocated
+  // up front. Each section's records arrive in index order.
+
+  void scene(size_t index, Scene&& scene) override {
+    append(file_.scenes_, index, std::move(scene));
+  }
+
+  void table1(size_t index, Table1Data&& table1) override {
+    append(file_.table1_, index, std::move(table1));
+  }
+
+  void variable(size_t index, Variable&& variable) override {
+    append(file_.variables_, index, std::move(variable));
+  }
+
+  void asset(section type, size_t index, AssetName&& asset) override {
+    switch (type) {
+      case bg_section:
+        append(file_.bg_names_, index, std::move(asset));
+        break;
+      case chr_section:
+        append(file_.chr_names_, index, std::move(asset));
+        break;
+      case se_section:
+        append(file_.se_names_, index, std::move(asset));
+        break;
+      case bgm_section:
+        append(file_.bgm_names_, index, std::move(asset));
+        break;
+      default:
+        break;
+    }
+  }
+
+ private:
+  template <typename Record>
+  static void append(record_vector<Record>& records, size_t index,
+                     Record&& record) {
+    Expects(index == records.size());
+    records.push_back(std::move(record));
+  }
+
+  SCXFile& file_;
+};
+
+bool SCXFile::read(istream& in) try {
+  // Decode into a fresh SCXFile, so a failure leaves this one untouched. The
+  // records are appended, so a monotonic buffer keeps each block they outgrow.
+  SCXFile loaded = fresh();
+  StreamBuilder builder(loaded);
+  SCXDecoder decoder(builder);
+
+  vector<char> chunk(0x10000);
+  while (in) {
+    in.read(chunk.data(), chunk.size());
+    multi_span<const char> received(chunk.data(), in.gcount());
+    if (!decoder.feed(as_bytes(received))) {
+      return false;
+    }
   }
 
-  if (calc != ident.checksum) {
+  if (in.bad() || !decoder.finish()) {
     return false;
   }
+  // Voice file names are not stored in this file, so only their count is
+  // kept, once the checksum has matched.
+  loaded.voice_count_ = decoder.count(voice_section);
+
+  if (interning_) {
+    loaded.pool_ = std::make_shared<StringPool>();
+    for (unsigned s = 0; s < section_count; ++s) {
+      loaded.intern(static_cast<section>(s));
+    }
+  }
+  swap(loaded);
+  return true;
+} catch (...) {
+  return false;
+}
 
-  // Extract and advance past an SCXFileHeader
-  const auto& header =
-      as_multi_span<SCXFileHeader>(buffer.first<sizeof(SCXFileHeader)>())[0];
-  buffer = buffer.subspan(sizeof(SCXFileHeader));
-
-  // Extract and advance past a table of uint32 offsets to variable-sized string
-  // data
-  auto scene_string_offsets = as_multi_span<const uint32_t>(
-      buffer.first(sizeof(uint32_t) * header.scene_count));
-  buffer = buffer.subspan(scene_string_offsets.size_bytes());
-
-  // Extract and advance past an array of 0xd8-byte data structures
-  scene_blobs_span scene_blobs =
-      as_multi_span(buffer.first(Scene::blob_size * header.scene_count),
-                    dim<>(header.scene_count), dim<Scene::blob_size>());
-  buffer = buffer.subspan(scene_blobs.size_bytes());
-
-  // Extract and advance past an array of 0xc-byte data structures
-  variable_blobs_span variable_blobs =
-      as_multi_span(buffer.first(Variable::blob_size *
-                                 header.counts[SCXFileHeader::variable]),
-                    dim<>(header.counts[SCXFileHeader::variable]),
-                    dim<Variable::blob_size>());
-  buffer = buffer.subspan(variable_blobs.size_bytes());
+bool SCXFile::read(const SCXView& view) try {
+  // Into a fresh SCXFile, so a failure leaves this one untouched
+  SCXFile loaded = fresh();
+  const auto& owner = view.owner();
+
+  loaded.scenes_.resize(view.scene_count());
+  const auto jumps = std::make_shared<SceneJumpPool>();
+  for (size_t i = 0; i < loaded.scenes_.size(); ++i) {
+    const auto ref = view.scene(i);
+    auto& scene = loaded.scenes_[i];
+    scene.read_data(nullptr, ref.blob(), owner, jumps);
+    // The view bounds the text by the section it lies in, as read does
+    if (ref.has_text()) {
+      const auto text = ref.text();
+      scene.text = LazyText::from_cp932(
+          multi_span<const char>(text.data(), text.size()), owner);
+    }
+  }
+
+  loaded.table1_.resize(view.table1_count());
+  for (size_t i = 0; i < loaded.table1_.size(); ++i) {
+    loaded.table1_[i].read_data(view.table1_string(i));
+  }
+
+  loaded.variables_.resize(view.variable_count());
+  for (size_t i = 0; i < loaded.variables_.size(); ++i) {
+    const auto ref = view.variable(i);
+    loaded.variables_[i].read_data(ref.string0(), ref.string1(), ref.blob());
+  }
+
+  auto read_assets = [&view](
+      record_vector<AssetName>& assets, size_t count,
+      SCXView::AssetRef (SCXView::*asset)(size_t) const) {
+    assets.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      const auto ref = (view.*asset)(i);
+      assets[i].read_data(ref.string0(), ref.string1());
+    }
+  };
+  read_assets(loaded.bg_names_, view.bg_count(), &SCXView::bg);
+  read_assets(loaded.chr_names_, view.chr_count(), &SCXView::chr);
+  read_assets(loaded.se_names_, view.se_count(), &SCXView::se);
+  read_assets(loaded.bgm_names_, view.bgm_count(), &SCXView::bgm);
+  // Voice file names are not stored in this file.
+  loaded.voice_count_ = view.voice_count();
+
+  if (interning_) {
+    loaded.pool_ = std::make_shared<StringPool>(owner);
+    for (unsigned s = 0; s < section_count; ++s) {
+      loaded.intern(static_cast<section>(s));
+    }
+  }
+  swap(loaded);
+  return true;
+} catch (...) {
+  return false;
+}
+
+bool SCXFile::verify_checksum() const {
+  if (!image_) {
+    return true;
+  }
+  return image_->checksum() == image_->expected_checksum;
+}
+
+SCXFile::verify_result SCXFile::verify(const string& fileName) try {
+  verify_result result{verify_status::ok, 0, 0, 0};
+
+  mapped_region region(file_mapping(fileName.c_str(), read_only), read_only);
+  multi_span<const byte> buffer(static_cast<const byte*>(region.get_address()),
+                                narrow_cast<ptrdiff_t>(region.get_size()));
+  result.file_size = region.get_size();
+  if (result.file_size < SCXFileHeader::offset + SCXFileHeader::size) {
+    result.status = verify_status::truncated;
+    return result;
+  }
+
+  const auto& ident = as_multi_span<SCXFileIdentifier>(
+      buffer.first<sizeof(SCXFileIdentifier)>())[0];
+  if (memcmp(&ident.fileprefix, "scx\0", 4)) {
+    result.status = verify_status::bad_prefix;
+    return result;
+  }
+
+  result.stored_checksum = ident.checksum;
+  result.computed_checksum =
+      cipher::checksum(buffer.subspan(SCXFileHeader::offset));
+  if (result.computed_checksum != result.stored_checksum) {
+    result.status = verify_status::bad_checksum;
+    return result;
+  }
+
+  SCXFileHeader header;
+  cipher::decrypt(buffer.subspan(SCXFileHeader::offset, SCXFileHeader::size),
+                  as_writeable_bytes(multi_span<SCXFileHeader>(&header, 1)), 0);
+  if (!header.fits(result.file_size)) {
+    result.status = verify_status::bad_section;
+    return result;
+  }
+
+  // The scene text offsets, a block at a time
+  array<uint32_t, 0x400> offsets;
+  for (size_t first = 0; first < header.scene_count; first += offsets.size()) {
+    const auto count = min(offsets.size(), header.scene_count - first);
+    const auto position = SCXFileHeader::text_offset_field(first);
+    auto block = multi_span<uint32_t>(offsets).first(count);
+    cipher::decrypt(buffer.subspan(position, count * sizeof(uint32_t)),
+                    as_writeable_bytes(block),
+                    position - SCXFileHeader::offset);
+    if (SCXFileHeader::misplaced_text(block, result.file_size) != count) {
+      result.status = verify_status::bad_scene_text;
+      return result;
+    }
+  }
+
+  return result;
+} catch (...) {
+  return verify_result{verify_status::unreadable, 0, 0, 0};
+}
+
+void SCXFile::load_all() const {
+  for (unsigned s = 0; s < section_count; ++s) {
+    load(static_cast<section>(s));
+  }
+}
+
+size_t SCXFile::pending_count(section s) const {
+  const auto& layout = image_->layout;
+  switch (s) {
+    case scene_section:
+      return layout.scene_count();
+    case table1_section:
+      return layout.count(SCXFileHeader::table1);
+    case variable_section:
+      return layout.count(SCXFileHeader::variable);
+    case bg_section:
+      return layout.count(SCXFileHeader::BG);
+    case chr_section:
+      return layout.count(SCXFileHeader::CHR);
+    case se_section:
+      return layout.count(SCXFileHeader::SE);
+    case bgm_section:
+      return layout.count(SCXFileHeader::BGM);
+    case voice_section:
+      return layout.count(SCXFileHeader::VOICE);
+    default:
+      return 0;
+  }
+}
+
+template <typename Add>
+void SCXFile::read_scenes(Add add) const {
+  auto& image = *image_;
+  const auto& layout = image.layout;
 
   // All offsets are relative to the whole file
-  buffer = storage;
+  multi_span<const byte> buffer(image.bytes);
+  // Text is decoded when first used, so the records keep the image alive
+  const std::shared_ptr<const void> owner = image_;
+
+  // The table of uint32 offsets to variable-sized string data, then an array
+  // of 0xd8-byte data structures
+  image.decrypt(SCXFileHeader::scene_string_offsets_offset,
+                layout.variable_blobs_offset());
+  const auto scene_string_offsets = layout.scene_text_offsets(buffer);
+  const auto scene_blobs = layout.scene_blobs(buffer);
+
+  // The text normally all sits in the region after the blobs, which is
+  // decoded in one go. Anything elsewhere is decoded by itself.
+  const size_t text_offset = layout.blobs_end();
+  const size_t text_end = text_offset < layout.file_size()
+                              ? image.text_end(text_offset)
+                              : text_offset;
+  image.decrypt(text_offset, text_end);
+  const char* text = as_multi_span<const char>(buffer).data();
+  const auto text_arena = std::make_shared<const TextArena>(
+      multi_span<const char>(text + text_offset,
+                             narrow_cast<ptrdiff_t>(text_end - text_offset)),
+      owner);
+  for (size_t i = 0; i < scene_string_offsets.size(); ++i) {
+    const auto offset = scene_string_offsets[i];
+    if (offset) {
+      image.decrypt(offset, image.text_end(offset));
+    }
+  }
 
   // A blob and a variable string per scene
-  read_scene_data(scenes_, scene_blobs, scene_string_offsets, buffer);
-
-  // A fixed string per table1 entry
-  fixed_strings_span table1_string_buffers = as_multi_span(
-      buffer.subspan(header.offsets[SCXFileHeader::table1],
-                     fixed_string_size * header.counts[SCXFileHeader::table1]),
-      dim<>(header.counts[SCXFileHeader::table1]), dim<fixed_string_size>());
-  read_table1_data(table1_, table1_string_buffers);
-
-  // A blob and a pair of fixed strings per variable
-  fixed_string_pairs_span variable_strings_buffers =
-      as_multi_span(buffer.subspan(header.offsets[SCXFileHeader::variable],
-                                   fixed_string_size * 2 *
-                                       header.counts[SCXFileHeader::variable]),
-                    dim<>(header.counts[SCXFileHeader::variable]), dim<2>(),
-                    dim<fixed_string_size>());
-  read_variable_data(variables_, variable_blobs, variable_strings_buffers);
-
-// Here on are all pairs of fixed strings
-#define READ_ASSET_STRINGS(ASSETTYPE, STORAGE)                                \
-  fixed_string_pairs_span ASSETTYPE##_strings_buffers =                       \
-      as_multi_span(buffer.subspan(header.offsets[SCXFileHeader::ASSETTYPE],  \
-                                   header.counts[SCXFileHeader::ASSETTYPE] *  \
-                                       fixed_string_size * 2),                \
-                    dim<>(header.counts[SCXFileHeader::ASSETTYPE]), dim<2>(), \
-                    dim<fixed_string_size>());                                \
-  read_asset_strings(STORAGE, ASSETTYPE##_strings_buffers);
-
-  READ_ASSET_STRINGS(BG, bg_names_);
-  READ_ASSET_STRINGS(CHR, chr_names_);
-  READ_ASSET_STRINGS(SE, se_names_);
-  READ_ASSET_STRINGS(BGM, bgm_names_);
-  // Voice file names are not stored in this file.
-  assert(header.offsets[SCXFileHeader::VOICE] == 0);
-  voice_names_.resize(header.counts[SCXFileHeader::VOICE]);
-// READ_ASSET_STRINGS(VOICE, voice_names_);
+  read_scene_data(add, scene_blobs, scene_string_offsets, text,
+                  [&image](size_t offset) { return image.text_end(offset); },
+                  owner, text_arena);
+}
+
+SceneTable SCXFile::scene_table() const {
+  SceneTable table;
+  if (!(pending_ & (1u << scene_section))) {
+    table.reserve(scenes_.size());
+    for (const auto& scene : scenes_) {
+      table.push_back(scene);
+    }
+    return table;
+  }
 
-#undef READ_ASSET_STRINGS
+  // Straight from the image, without decoding the section into scenes_
+  table.reserve(pending_count(scene_section));
+  read_scenes([this, &table](size_t, Scene&& scene) {
+    if (pool_) {
+      scene.text.intern(pool_);
+    }
+    table.push_back(std::move(scene));
+  });
+  return table;
+}
 
-  return true;
+void SCXFile::decode(section s) const {
+  auto& image = *image_;
+  const auto& layout = image.layout;
+
+  // All offsets are relative to the whole file
+  multi_span<const byte> buffer(image.bytes);
+
+  // Each kind of fixed string is a section of its own
+  auto decrypted_strings = [&image, &layout,
+                            buffer](SCXFileHeader::fixed_strings which) {
+    const size_t offset = layout.strings_offset(which);
+    image.decrypt(offset, offset + layout.strings_size(which));
+    return layout.strings(buffer, which);
+  };
+
+  switch (s) {
+    case scene_section:
+      scenes_.resize(layout.scene_count());
+      read_scenes([this](size_t index, Scene&& scene) {
+        scenes_[index] = std::move(scene);
+      });
+      break;
+
+    case table1_section:
+      // A fixed string per table1 entry
+      read_table1_data(table1_, decrypted_strings(SCXFileHeader::table1));
+      break;
+
+    case variable_section: {
+      // A blob and a pair of fixed strings per variable. The blobs follow the
+      // scenes' (see read_scenes).
+      const auto variable_blobs = layout.variable_blobs(buffer);
+      image.decrypt(layout.variable_blobs_offset(),
+                    layout.variable_blobs_offset() +
+                        variable_blobs.size_bytes());
+      read_variable_data(variables_, variable_blobs,
+                         decrypted_strings(SCXFileHeader::variable));
+      break;
+    }
+
+    // Here on are all pairs of fixed strings
+    case bg_section:
+      read_asset_strings(bg_names_, decrypted_strings(SCXFileHeader::BG));
+      break;
+    case chr_section:
+      read_asset_strings(chr_names_, decrypted_strings(SCXFileHeader::CHR));
+      break;
+    case se_section:
+      read_asset_strings(se_names_, decrypted_strings(SCXFileHeader::SE));
+      break;
+    case bgm_section:
+      read_asset_strings(bgm_names_, decrypted_strings(SCXFileHeader::BGM));
+      break;
+    case voice_section:
+      // Voice file names are not stored in this file, which misfit checks
+      voice_count_ = layout.count(SCXFileHeader::VOICE);
+      break;
+
+    default:
+      break;
+  }
+
+  pending_ &= ~(1u << s);
+  if (pool_) {
+    intern(s);
+  }
+}
+
+void SCXFile::intern(section s) const {
+  auto intern_assets = [this](record_vector<AssetName>& assets) {
+    for (auto& asset : assets) {
+      asset.name.intern(pool_);
+      asset.abbreviation.intern(pool_);
+    }
+  };
+
+  switch (s) {
+    case scene_section:
+      for (auto& scene : scenes_) {
+        scene.text.intern(pool_);
+      }
+      break;
+    case table1_section:
+      for (auto& table1_entry : table1_) {
+        table1_entry.data.intern(pool_);
+      }
+      break;
+    case variable_section:
+      for (auto& variable : variables_) {
+        variable.name.intern(pool_);
+        variable.comment.intern(pool_);
+      }
+      break;
+    case bg_section:
+      intern_assets(bg_names_);
+      break;
+    case chr_section:
+      intern_assets(chr_names_);
+      break;
+    case se_section:
+      intern_assets(se_names_);
+      break;
+    case bgm_section:
+      intern_assets(bgm_names_);
+      break;
+    default:
+      break;
+  }
+}
+
+bool SCXFile::write(const string& fileName) try {
+  // Fixed strings are encoded after the file is laid out, so are checked
+  // before anything is written
+  load_all();
+  if (!fixed_strings_fit()) {
+    return false;
+  }
+
+  // Text not yet decoded is still read from the mapping of the file it came
+  // from, which truncating that file would lose. The new file replaces it
+  // only once complete, leaving it as it was if writing fails.
+  const path target(fileName);
+  const path temporary =
+      target.parent_path() /
+      unique_path(target.filename().string() + ".%%%%-%%%%.tmp");
+  boost::system::error_code error;
+  if (write_new(temporary.string())) {
+    rename(temporary, target, error);
+    if (!error) {
+      return true;
+    }
+  }
+  remove(temporary, error);
+  return false;
 } catch (...) {
   return false;
 }
 
-bool SCXFile::write(const string& fileName) {
+bool SCXFile::fixed_strings_fit() const {
+  auto fits = [this](const FixedText& text) {
+    return text.cp932_size(unmappable_) <= fixed_string_size;
+  };
+  for (const auto& table1_entry : table1_) {
+    if (!fits(table1_entry.data)) {
+      return false;
+    }
+  }
+  for (const auto& variable : variables_) {
+    if (!fits(variable.name) || !fits(variable.comment)) {
+      return false;
+    }
+  }
+  for (const auto* assets :
+       {&bg_names_, &chr_names_, &se_names_, &bgm_names_}) {
+    for (const auto& asset : *assets) {
+      if (!fits(asset.name) || !fits(asset.abbreviation)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool SCXFile::write_new(const string& fileName) try {
+  load_all();
+
   // How this will work:
   /* Roughly, we have the fixed-size data structures, then the var-len strings,
    * then the fixed-size strings.
@@ -419,49 +1167,85 @@ bool SCXFile::write(const string& fileName) {
       (table1_.size() + variables_.size() * 2 + bg_names_.size() * 2 +
        chr_names_.size() * 2 + se_names_.size() * 2 + bgm_names_.size() * 2);
 
-  // Start with some storage to collect all the scene data, as that is the only
-  // part that varies in size.
-  scene_storage_data scene_data(scenes_.size());
-
+  // The scene text is the only part that varies in size. It is sized here,
+  // and encoded straight into the file once that is laid out. Scenes which
+  // still share the text they were read with share it in the file too.
+  // When deduplicating, all scenes with the same text share it.
+  // Deduplicating has to encode the text to compare it, so keeps it to be
+  // copied rather than encoded again.
+  auto first_with_text = first_with_same_text(scenes_);
+  vector<char> encoded;
+  vector<multi_span<const char>> cp932_texts;
+  if (deduplicating_) {
+    first_with_text = first_with_same_cp932(scenes_, first_with_text,
+                                            unmappable_, encoded, cp932_texts);
+  }
   size_t scene_text_size_total = 0;
   for (size_t i = 0; i < scenes_.size(); ++i) {
-    const auto& scene = scenes_[i];
-    auto& output = scene_data[i];
-    output.second = scene.write_data(output.first);
-    if (output.second) {
+    if (first_with_text[i] != i) {
+      continue;
+    }
+    const size_t text_size =
+        cp932_texts.empty() ? scenes_[i].text.cp932_size(unmappable_)
+                            : static_cast<size_t>(cp932_texts[i].size());
+    if (text_size != 0) {
       // Seems to be a bug in the game client if this does not hold
       // TODO: Test this and see if simple '\0'-padding fixes it.
       // Alternatively, could be a bug with narrow-width ASCII rendering?
       // TODO: Actually, this is not accurate. The _text_ (i.e. not things in
       // []) probably needs to be a multiple of 2 bytes. It's probably a bug in
       // the command-parser.
-      //      assert(output.second->size() % 2 == 0);
+      //      assert(text_size % 2 == 0);
 
       // Need to allow for the null
-      scene_text_size_total += output.second->size() + 1;
+      scene_text_size_total += text_size + 1;
     }
   }
 
-  vector<byte> storage(pre_text_size + scene_text_size_total + post_text_size);
+  const size_t file_size =
+      pre_text_size + scene_text_size_total + post_text_size;
+
+  // Create a new file of the desired size
+  {
+    filebuf fbuf;
+    if (!fbuf.open(fileName.c_str(), ios_base::in | ios_base::out |
+                                         ios_base::trunc | ios_base::binary)) {
+      return false;
+    }
+    fbuf.pubseekoff(file_size - 1, ios_base::beg);
+    fbuf.sputc('\0');
+  }
+
+  // Each region is filled and encrypted straight into the mapped file
+  file_mapping file(fileName.c_str(), read_write);
+  mapped_region region(file, read_write);
+  void* addr = region.get_address();
+  size_t size = region.get_size();
 
-  // Now we can just write all the data out.
-  multi_span<byte> buffer(storage);
+  assert(size == file_size);
+
+  multi_span<byte> storage(reinterpret_cast<byte*>(addr),
+                           narrow_cast<ptrdiff_t>(size));
+
+  uint32_t calc = 0;
+  auto encrypt_range = [this, &storage, &calc](size_t begin, size_t end) {
+    auto range = storage.subspan(begin, end - begin);
+    calc += cipher::encrypt(range, range, begin - SCXFileHeader::offset,
+                            threads_);
+  };
 
-  // Take a reference to and advance past the SCXFileIdentifier
+  // Take a reference to the SCXFileIdentifier and SCXFileHeader
   auto& ident = as_multi_span<SCXFileIdentifier>(
-      buffer.first<sizeof(SCXFileIdentifier)>())[0];
-  buffer = buffer.subspan(sizeof(SCXFileIdentifier));
+      storage.first<sizeof(SCXFileIdentifier)>())[0];
+  auto& header = as_multi_span<SCXFileHeader>(
+      storage.subspan(SCXFileHeader::offset)
+          .first<sizeof(SCXFileHeader)>())[0];
 
   ident.fileprefix[0] = 's';
   ident.fileprefix[1] = 'c';
   ident.fileprefix[2] = 'x';
   ident.fileprefix[3] = '\0';
 
-  // Take a reference to and advance past the SCXFileHeader
-  auto& header =
-      as_multi_span<SCXFileHeader>(buffer.first<sizeof(SCXFileHeader)>())[0];
-  buffer = buffer.subspan(sizeof(SCXFileHeader));
-
   // Fill in the counts, since we have those now
   header.scene_count = narrow_cast<uint32_t>(scenes_.size());
   header.counts[SCXFileHeader::table1] = narrow_cast<uint32_t>(table1_.size());
@@ -472,111 +1256,58 @@ bool SCXFile::write(const string& fileName) {
   header.counts[SCXFileHeader::SE] = narrow_cast<uint32_t>(se_names_.size());
   header.counts[SCXFileHeader::BGM] = narrow_cast<uint32_t>(bgm_names_.size());
   header.counts[SCXFileHeader::VOICE] =
-      narrow_cast<uint32_t>(voice_names_.size());
-
-  // Take a reference to and advance past a table of uint32 offsets to
-  // variable-sized string data
-  auto scene_string_offsets = as_multi_span<uint32_t>(
-      buffer.first(sizeof(uint32_t) * header.scene_count));
-  buffer = buffer.subspan(scene_string_offsets.size_bytes());
-
-  // Take a reference to and advance past an array of 0xd8-byte data structures
-  scene_blobs_writeable_span scene_blobs =
-      as_multi_span(buffer.first(Scene::blob_size * header.scene_count),
-                    dim<>(header.scene_count), dim<Scene::blob_size>());
-  buffer = buffer.subspan(scene_blobs.size_bytes());
-
-  // Take a reference to and advance past an array of 0xc-byte data structures
-  variable_blobs_writeable_span variable_blobs =
-      as_multi_span(buffer.first(Variable::blob_size *
-                                 header.counts[SCXFileHeader::variable]),
-                    dim<>(header.counts[SCXFileHeader::variable]),
-                    dim<Variable::blob_size>());
-  buffer = buffer.subspan(variable_blobs.size_bytes());
-
-  assert(buffer.size_bytes() == scene_text_size_total + post_text_size);
-
-  // Take a reference to and advance past the variably-sized string buffer
-  auto scene_text_blob = as_multi_span(buffer.first(scene_text_size_total),
-                                       dim<>(scene_text_size_total));
-  buffer = buffer.subspan(scene_text_blob.size_bytes());
-
-  assert(buffer.size_bytes() == post_text_size);
-
-  write_scene_data(scene_data, scene_blobs, scene_string_offsets,
-                   scene_text_blob, narrow_cast<uint32_t>(pre_text_size));
-
-  // Take a reference to and advance past each of the fixed-size-string buffers
-  header.offsets[SCXFileHeader::table1] =
-      narrow_cast<uint32_t>(storage.size() - buffer.size_bytes());
-  fixed_strings_writeable_span table1_string_buffers = as_multi_span(
-      buffer.first(fixed_string_size * header.counts[SCXFileHeader::table1]),
-      dim<>(header.counts[SCXFileHeader::table1]), dim<fixed_string_size>());
-  buffer = buffer.subspan(table1_string_buffers.size_bytes());
-
-  write_table1_data(table1_, table1_string_buffers);
-
-  header.offsets[SCXFileHeader::variable] =
-      narrow_cast<uint32_t>(storage.size() - buffer.size_bytes());
-  fixed_string_pairs_writeable_span variable_strings_buffers =
-      as_multi_span(buffer.first(fixed_string_size * 2 *
-                                 header.counts[SCXFileHeader::variable]),
-                    dim<>(header.counts[SCXFileHeader::variable]), dim<2>(),
-                    dim<fixed_string_size>());
-  buffer = buffer.subspan(variable_strings_buffers.size_bytes());
-
-  write_variable_data(variables_, variable_blobs, variable_strings_buffers);
-
-#define WRITE_ASSET_STRINGS(ASSETTYPE, STORAGE)                               \
-  header.offsets[SCXFileHeader::ASSETTYPE] =                                  \
-      narrow_cast<uint32_t>(storage.size() - buffer.size_bytes());            \
-  fixed_string_pairs_writeable_span ASSETTYPE##_strings_buffers =             \
-      as_multi_span(buffer.first(fixed_string_size * 2 *                      \
-                                 header.counts[SCXFileHeader::ASSETTYPE]),    \
-                    dim<>(header.counts[SCXFileHeader::ASSETTYPE]), dim<2>(), \
-                    dim<fixed_string_size>());                                \
-  buffer = buffer.subspan(ASSETTYPE##_strings_buffers.size_bytes());          \
-  write_asset_strings(STORAGE, ASSETTYPE##_strings_buffers);
-
-  WRITE_ASSET_STRINGS(BG, bg_names_);
-  WRITE_ASSET_STRINGS(CHR, chr_names_);
-  WRITE_ASSET_STRINGS(SE, se_names_);
-  WRITE_ASSET_STRINGS(BGM, bgm_names_);
-// Voice file names are not stored in this file.
-// WRITE_ASSET_STRINGS(VOICE, voice_names_);
-
-#undef WRITE_ASSET_STRINGS
-
-  assert(buffer.size_bytes() == 0);
-
-  auto encrypted = multi_span<byte>(storage).subspan(sizeof(SCXFileIdentifier));
-  uint32_t calc = 0;
-  for (ptrdiff_t i = 0; i < encrypted.extent(); ++i) {
-    // Encrypt: Unsigned math
-    reinterpret_cast<uint8_t&>(encrypted[i]) ^= xor_key(i);
-    // Checksum: Signed math
-    calc += static_cast<int8_t>(encrypted[i]);
+      narrow_cast<uint32_t>(voice_count_);
+
+  // The fixed-size strings follow the scene text, in this order
+  size_t strings_offset = pre_text_size + scene_text_size_total;
+  for (auto which : {SCXFileHeader::table1, SCXFileHeader::variable,
+                     SCXFileHeader::BG, SCXFileHeader::CHR, SCXFileHeader::SE,
+                     SCXFileHeader::BGM}) {
+    header.offsets[which] = narrow_cast<uint32_t>(strings_offset);
+    strings_offset += header.counts[which] * fixed_string_size *
+                      SCXLayout::strings_per_record(which);
   }
+  // Voice file names are not stored in this file.
+  assert(strings_offset == file_size);
 
-  ident.checksum = calc;
-
-  // Create a new file of the desired size
-  {
-    filebuf fbuf;
-    fbuf.open(fileName.c_str(), ios_base::in | ios_base::out | ios_base::trunc |
-                                    ios_base::binary);
-    fbuf.pubseekoff(storage.size() - 1, ios_base::beg);
-    fbuf.sputc('\0');
+  // Everything else is where the header now says
+  SCXLayout layout;
+  if (!layout.locate(header, file_size)) {
+    return false;
   }
+  auto scene_text_blob =
+      storage.subspan(pre_text_size, scene_text_size_total);
+
+  // Everything after the header up to the end of the scene text is filled by
+  // these two. The header is still needed, so is encrypted last.
+  write_scene_data(scenes_, first_with_text, cp932_texts,
+                   layout.scene_blobs(storage),
+                   layout.scene_text_offsets(storage), scene_text_blob,
+                   narrow_cast<uint32_t>(pre_text_size), unmappable_);
+  write_variable_data(variables_, layout.variable_blobs(storage),
+                      layout.strings(storage, SCXFileHeader::variable),
+                      unmappable_);
+  encrypt_range(SCXFileHeader::offset + SCXFileHeader::size,
+                pre_text_size + scene_text_size_total);
+
+  write_table1_data(table1_, layout.strings(storage, SCXFileHeader::table1),
+                    unmappable_);
+  write_asset_strings(bg_names_, layout.strings(storage, SCXFileHeader::BG),
+                      unmappable_);
+  write_asset_strings(chr_names_, layout.strings(storage, SCXFileHeader::CHR),
+                      unmappable_);
+  write_asset_strings(se_names_, layout.strings(storage, SCXFileHeader::SE),
+                      unmappable_);
+  write_asset_strings(bgm_names_, layout.strings(storage, SCXFileHeader::BGM),
+                      unmappable_);
+  // Voice file names are not stored in this file.
+  encrypt_range(pre_text_size + scene_text_size_total, file_size);
 
-  file_mapping file(fileName.c_str(), read_write);
-  mapped_region region(file, read_write);
-  void* addr = region.get_address();
-  size_t size = region.get_size();
-
-  assert(size == storage.size());
-
-  memcpy(addr, storage.data(), size);
+  encrypt_range(SCXFileHeader::offset,
+                SCXFileHeader::offset + SCXFileHeader::size);
+  ident.checksum = calc;
 
   return true;
+} catch (...) {
+  return false;
 }
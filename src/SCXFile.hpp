@@ -1,47 +1,304 @@
+#pragma once
+
 #include "AssetName.hpp"
+#include "CP932.hpp"
 #include "Scene.hpp"
+#include "SceneTable.hpp"
+#include "StringPool.hpp"
 #include "Table1Data.hpp"
 #include "Variable.hpp"
 
+#include <iosfwd>
+#include <memory>
 #include <string>
-#include <vector>
+#include <type_traits>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <boost/container/pmr/memory_resource.hpp>
+#include <boost/container/pmr/polymorphic_allocator.hpp>
+#include <boost/container/vector.hpp>
+
+class SCXView;
+
+// Allocates an SCXFile's records from the memory resource of the read which
+// decoded them. The records go with their resource when moved or swapped, so
+// a file can take over what another has read.
+template <typename T>
+class record_allocator
+    : public boost::container::pmr::polymorphic_allocator<T> {
+ public:
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+  template <typename U>
+  struct rebind {
+    using other = record_allocator<U>;
+  };
+
+  record_allocator() noexcept = default;
+  record_allocator(boost::container::pmr::memory_resource* resource) noexcept
+      : boost::container::pmr::polymorphic_allocator<T>(resource) {}
+  template <typename U>
+  record_allocator(const record_allocator<U>& other) noexcept
+      : boost::container::pmr::polymorphic_allocator<T>(other.resource()) {}
+
+  // A copy of the records may outlive the resource
+  record_allocator select_on_container_copy_construction() const {
+    return record_allocator();
+  }
+};
+
+template <typename T>
+using record_vector = boost::container::vector<T, record_allocator<T>>;
 
 class SCXFile {
  public:
+  // Each read allocates the records from a monotonic buffer of its own, which
+  // is released in one go when the file is destroyed or reads another. Scene
+  // jump blobs are pooled on the heap, so scenes copied out of the file do not
+  // hold on to the buffer.
   SCXFile();
+  // Each read allocates the records from resource, which must outlive them
+  explicit SCXFile(boost::container::pmr::memory_resource* resource);
+  SCXFile(const SCXFile& other) = default;
+  SCXFile(SCXFile&& other) = default;
+  SCXFile& operator=(SCXFile other) {
+    swap(other);
+    return *this;
+  }
 
-  bool read(const std::string& fileName);
+  void swap(SCXFile& other) noexcept;
+
+  // How much of the file read decodes up front
+  enum class load_mode {
+    // Decrypt, checksum and decode everything during read
+    eager,
+    // Decrypt and decode only the header during read, and each section on
+    // first access. The file stays mapped until another file is read or the
+    // SCXFile is destroyed, and the accessors are not safe to call from more
+    // than one thread at a time. The checksum is only checked by
+    // verify_checksum.
+    lazy,
+  };
+
+  bool read(const std::string& fileName, load_mode mode = load_mode::eager);
+  // Decodes the file as it is read from the stream, see SCXDecoder
+  bool read(std::istream& in);
+  // Copies the records out of a view, for when they need changing. Scene text
+  // is decoded lazily if the view owns its bytes, which are then kept alive
+  // until it is.
+  bool read(const SCXView& view);
+  // The file is written alongside fileName, and only replaces it once
+  // complete, so it may be the file this one was read from.
   bool write(const std::string& fileName);
 
-  std::size_t scene_count() const { return scenes_.size(); }
-  std::size_t table1_count() const { return table1_.size(); }
-  std::size_t variable_count() const { return variables_.size(); }
-  std::size_t bg_count() const { return bg_names_.size(); }
-  std::size_t chr_count() const { return chr_names_.size(); }
-  std::size_t se_count() const { return se_names_.size(); }
-  std::size_t bgm_count() const { return bgm_names_.size(); }
-  std::size_t voice_count() const { return voice_names_.size(); }
-
-  const Scene& scene(std::size_t index) const { return scenes_[index]; }
-  const Table1Data& table1(std::size_t index) const { return table1_[index]; }
+  // Checks the checksum of a file read in lazy mode. Eager reads have already
+  // checked it, so this is always true for them.
+  bool verify_checksum() const;
+
+  enum class verify_status {
+    ok,
+    // The file could not be opened or mapped, or there was not the memory to
+    // read it
+    unreadable,
+    // Too short to hold the identifier and header
+    truncated,
+    // The file does not start with "scx\0"
+    bad_prefix,
+    bad_checksum,
+    // The header describes a section that does not fit in the file
+    bad_section,
+    // A scene's text offset points outside the encrypted region
+    bad_scene_text,
+    // A section's text could not be converted by the selected CP932
+    // converter (see cp932::set_converter). Only parse reports this.
+    undecodable,
+  };
+
+  enum section : unsigned {
+    scene_section,
+    table1_section,
+    variable_section,
+    bg_section,
+    chr_section,
+    se_section,
+    bgm_section,
+    voice_section,
+    section_count,
+  };
+
+  struct verify_result {
+    verify_status status;
+    std::size_t file_size;
+    // Only meaningful once the prefix has been checked
+    std::uint32_t stored_checksum;
+    std::uint32_t computed_checksum;
+
+    explicit operator bool() const { return status == verify_status::ok; }
+  };
+
+  // Why a read failed, and where
+  struct read_result {
+    verify_status status;
+    // The section found to be at fault, or section_count for the prefix,
+    // checksum, or a file which could not be read at all
+    section failed_section;
+    // The offset in the file of what was wrong: the header field describing
+    // the section (see SCXFileHeader::misfit), the scene's entry in the text
+    // offsets, the checksum, the end of a truncated file, or the start of a
+    // section which could not be decoded
+    std::uint64_t offset;
+
+    explicit operator bool() const { return status == verify_status::ok; }
+  };
+
+  // As read, but says why a file could not be read. Every count and offset in
+  // the header, and every scene text offset, is checked before any records
+  // are decoded, and nothing is thrown.
+  read_result parse(const std::string& fileName,
+                    load_mode mode = load_mode::eager) noexcept;
+
+  // Checks a file's prefix, checksum, and that the header's sections and the
+  // scene text offsets lie within it, without decoding any records. The file
+  // is mapped read-only and only the header and scene text offsets are
+  // decrypted, into small fixed buffers.
+  static verify_result verify(const std::string& fileName);
+
+  // Number of threads used to decrypt and encrypt large files. 0 means one
+  // per hardware thread. Defaults to 1.
+  void set_threads(unsigned threads) { threads_ = threads; }
+  unsigned threads() const { return threads_; }
+
+  // What write does with text CP932 cannot represent. Defaults to skip.
+  void set_unmappable(cp932::unmappable policy) { unmappable_ = policy; }
+  cp932::unmappable unmappable() const { return unmappable_; }
+
+  // Whether read keeps one copy of each distinct string in a pool, shared by
+  // every record with that text. Text is then decoded as each section is,
+  // rather than when first used, and the same text in two records compares
+  // equal by its handle alone: a scene's interned(), or a fixed string's
+  // interned() in string_pool(). Defaults to off.
+  void set_interning(bool interning) { interning_ = interning; }
+  bool interning() const { return interning_; }
+  // The pool of the file last read while interning, or null
+  const StringPool* string_pool() const { return pool_.get(); }
+
+  // Whether write stores each distinct scene text once, and points every
+  // scene with that text at it. The file is smaller, but its text is no
+  // longer laid out as the distributed version's is. Defaults to off.
+  void set_deduplicating(bool deduplicating) {
+    deduplicating_ = deduplicating;
+  }
+  bool deduplicating() const { return deduplicating_; }
+
+  std::size_t scene_count() const { return count(scene_section, scenes_); }
+  std::size_t table1_count() const { return count(table1_section, table1_); }
+  std::size_t variable_count() const {
+    return count(variable_section, variables_);
+  }
+  std::size_t bg_count() const { return count(bg_section, bg_names_); }
+  std::size_t chr_count() const { return count(chr_section, chr_names_); }
+  std::size_t se_count() const { return count(se_section, se_names_); }
+  std::size_t bgm_count() const { return count(bgm_section, bgm_names_); }
+  std::size_t voice_count() const {
+    return (pending_ & (1u << voice_section)) ? pending_count(voice_section)
+                                              : voice_count_;
+  }
+
+  // The scenes as columns, for scans over a few fields. In lazy mode, read
+  // straight from the file rather than decoding the scenes first.
+  SceneTable scene_table() const;
+
+  const Scene& scene(std::size_t index) const {
+    load(scene_section);
+    return scenes_[index];
+  }
+  const Table1Data& table1(std::size_t index) const {
+    load(table1_section);
+    return table1_[index];
+  }
   const Variable& variable(std::size_t index) const {
+    load(variable_section);
     return variables_[index];
   }
-  const AssetName& bg(std::size_t index) const { return bg_names_[index]; }
-  const AssetName& chr(std::size_t index) const { return chr_names_[index]; }
-  const AssetName& se(std::size_t index) const { return se_names_[index]; }
-  const AssetName& bgm(std::size_t index) const { return bgm_names_[index]; }
-  const AssetName& voice(std::size_t index) const {
-    return voice_names_[index];
+  const AssetName& bg(std::size_t index) const {
+    load(bg_section);
+    return bg_names_[index];
+  }
+  const AssetName& chr(std::size_t index) const {
+    load(chr_section);
+    return chr_names_[index];
   }
+  const AssetName& se(std::size_t index) const {
+    load(se_section);
+    return se_names_[index];
+  }
+  const AssetName& bgm(std::size_t index) const {
+    load(bgm_section);
+    return bgm_names_[index];
+  }
+  // Voice file names are not stored in this file, so every voice is unnamed
+  const AssetName& voice(std::size_t /*index*/) const { return unnamed_voice; }
 
  private:
-  std::vector<Scene> scenes_;
-  std::vector<Table1Data> table1_;
-  std::vector<Variable> variables_;
-  std::vector<AssetName> bg_names_;
-  std::vector<AssetName> chr_names_;
-  std::vector<AssetName> se_names_;
-  std::vector<AssetName> bgm_names_;
-  std::vector<AssetName> voice_names_;
+  // The mapped file, while any section is still to be decoded
+  struct Image;
+  // Fills in an SCXFile from an SCXDecoder
+  class StreamBuilder;
+
+  void load(section s) const {
+    if (pending_ & (1u << s)) {
+      decode(s);
+    }
+  }
+  void load_all() const;
+  void decode(section s) const;
+  // Reads each scene from the image, calling add(index, Scene&&)
+  template <typename Add>
+  void read_scenes(Add add) const;
+  void intern(section s) const;
+  // Whether every fixed string fits in one once encoded. Throws
+  // cp932::conversion_error as encoding them would.
+  bool fixed_strings_fit() const;
+  // Writes the file to fileName, which is created or truncated
+  bool write_new(const std::string& fileName);
+
+  // An empty file with this one's settings, to read into
+  SCXFile fresh() const;
+
+  template <typename T>
+  std::size_t count(section s, const record_vector<T>& records) const {
+    return (pending_ & (1u << s)) ? pending_count(s) : records.size();
+  }
+  std::size_t pending_count(section s) const;
+
+  // What the records are allocated from, if not the caller's. Declared before
+  // them, so it outlives them.
+  std::shared_ptr<boost::container::pmr::memory_resource> resource_;
+  // The caller's resource, or null for a monotonic buffer per read
+  boost::container::pmr::memory_resource* caller_resource_;
+
+  // Sections are decoded on first access in lazy mode
+  mutable record_vector<Scene> scenes_;
+  mutable record_vector<Table1Data> table1_;
+  mutable record_vector<Variable> variables_;
+  mutable record_vector<AssetName> bg_names_;
+  mutable record_vector<AssetName> chr_names_;
+  mutable record_vector<AssetName> se_names_;
+  mutable record_vector<AssetName> bgm_names_;
+  // Only the count of voices is stored, so they take no memory however many
+  // a file claims
+  mutable std::size_t voice_count_;
+  static const AssetName unnamed_voice;
+
+  std::shared_ptr<Image> image_;
+  // One bit per section not yet decoded from image_
+  mutable unsigned pending_;
+
+  unsigned threads_;
+  cp932::unmappable unmappable_;
+  bool interning_;
+  std::shared_ptr<StringPool> pool_;
+  bool deduplicating_;
 };
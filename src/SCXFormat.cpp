@@ -0,0 +1,74 @@
+#include "SCXFormat.hpp"
+
+#include "Scene.hpp"
+#include "Variable.hpp"
+
+#include <cstddef>
+using std::size_t;
+#include <cstdint>
+using std::uint64_t;
+
+uint64_t SCXFileHeader::scene_blobs_offset() const {
+  return scene_string_offsets_offset +
+         uint64_t{scene_count} * sizeof(std::uint32_t);
+}
+
+uint64_t SCXFileHeader::variable_blobs_offset() const {
+  return scene_blobs_offset() + uint64_t{scene_count} * Scene::blob_size;
+}
+
+uint64_t SCXFileHeader::blobs_end() const {
+  return variable_blobs_offset() +
+         uint64_t{counts[variable]} * Variable::blob_size;
+}
+
+const size_t SCXFileHeader::scene_string_offsets_offset;
+const size_t SCXFileHeader::scene_count_field;
+
+uint64_t SCXFileHeader::text_end(uint64_t text, uint64_t file_size) const {
+  uint64_t end = file_size;
+  auto bound = [text, &end](uint64_t start) {
+    if (start > text && start < end) {
+      end = start;
+    }
+  };
+  bound(blobs_end());
+  for (size_t i = 0; i < COUNT; ++i) {
+    if (i != VOICE && counts[i] != 0) {
+      bound(offsets[i]);
+    }
+  }
+  return end;
+}
+
+size_t SCXFileHeader::misfit(uint64_t file_size) const {
+  if (variable_blobs_offset() > file_size) {
+    return scene_count_field;
+  }
+  if (blobs_end() > file_size) {
+    return count_field(variable);
+  }
+
+  // Voice file names are not stored in this file, so they have no offset,
+  // and their count takes no room in it
+  if (offsets[VOICE] != 0) {
+    return offset_field(VOICE);
+  }
+
+  for (size_t i = 0; i < COUNT; ++i) {
+    if (i == VOICE || counts[i] == 0) {
+      continue;
+    }
+    const auto which = static_cast<fixed_strings>(i);
+    const uint64_t strings_size =
+        i == table1 ? fixed_string_size : fixed_string_size * 2;
+    const uint64_t begin = offsets[i];
+    if (begin < offset || begin > file_size) {
+      return offset_field(which);
+    }
+    if (begin + counts[i] * strings_size > file_size) {
+      return count_field(which);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+
+#include <cstddef>
+#include <cstdint>
+
+/* Structure:
+4 bytes scx\0  - Not encrypted
+4 byte checksum  - Not encrypted, checksum of encrypted data
+// Everything below here is XOR'd against:
+//  0xa9 0xb3 0xf2 0x87 0xdc 0xaf 0x13 0x67 0xd5 0x91 0xec
+0x08: uint32 scene_count (16913)
+0x0c: uint32 table1_count (474)
+0x10: uint32 variable_count (781)
+0x14: uint32 BG_count
+0x18: uint32 CHR_count
+0x1c: uint32 SE_count
+0x20: uint32 BGM_count
+0x24: uint32 VOICE_count
+0x28: uint32 table1_strings_offset
+0x2c: uint32 variable_names_offset
+Asset names:
+0x30: uint32 BG_names_offset
+0x34: uint32 CHR_names_offset
+0x38: uint32 SE_names_offset
+0x3c: uint32 BGM_names_offset
+0x40: uint32 VOICE_names_offset
+STRING OFFSETS:
+0x44: scene_count * uint32 string offsets (may be 0 - no string)
+BLOBS: following the scene offsets
+....: scene_count * 0xd8 scene info blobs
+....: variable_count * 0xc variable info blobs
+STRINGS: Offsets read from header
+....: table1 strings (0x20 byte fixed string buffer, stops at first null)
+....: variable string-pairs (0x20 byte fixed string buffer, stops at first null,
+x2)
+  Looks like comment then description.
+....: Asset name string-pairs (0x20 byte fixed string buffer, stops at first
+null, x2)
+  Looks like name then display-name?
+*/
+
+// All data is little-endian
+// Not encrypted
+struct SCXFileIdentifier {
+  const static std::size_t size = 0x08;
+  const static std::size_t offset = 0x0;
+
+  char fileprefix[4];  // "scx\0"
+  std::uint32_t checksum;
+};
+
+static_assert(sizeof(SCXFileIdentifier) == SCXFileIdentifier::size,
+              "SCXFileIdentifier did not pack correctly");
+
+// All following data is encrypted
+struct SCXFileHeader {
+  const static std::size_t size = 0x3c;
+  const static std::size_t offset = 0x08;
+
+  enum fixed_strings : std::size_t {
+    table1,
+    variable,
+    BG,
+    CHR,
+    SE,
+    BGM,
+    VOICE,
+    COUNT,
+  };
+
+  std::uint32_t scene_count;
+  std::array<std::uint32_t, COUNT> counts;
+  std::array<std::uint32_t, COUNT> offsets;
+
+  // Where the blobs sit, which follows from the counts. In 64 bits, so the
+  // counts in a corrupt header cannot wrap.
+  static const std::size_t scene_string_offsets_offset = offset + size;
+  std::uint64_t scene_blobs_offset() const;
+  std::uint64_t variable_blobs_offset() const;
+  std::uint64_t blobs_end() const;
+
+  // Checks every section lies within a file of this size
+  bool fits(std::uint64_t file_size) const { return misfit(file_size) == 0; }
+  // The offset in the file of the first field which puts a section outside a
+  // file of this size, or 0 if none does. That is the offset of a section
+  // which starts outside the file, or of the voice names, which are not
+  // stored, else the count of one which runs past its end, or scene_count if
+  // the blobs do.
+  std::size_t misfit(std::uint64_t file_size) const;
+  // The offsets in the file of the fields above
+  static const std::size_t scene_count_field = offset;
+  static std::size_t count_field(fixed_strings which) {
+    return offset + sizeof(std::uint32_t) * (1 + which);
+  }
+  static std::size_t offset_field(fixed_strings which) {
+    return offset + sizeof(std::uint32_t) * (1 + COUNT + which);
+  }
+
+  // The index of the first scene text offset which does not start within the
+  // encrypted part of a file of this size, or offsets.size() if every one
+  // does. 0 means the scene has no text. Text runs from its offset to the
+  // next null or text_end, so only the offset needs checking.
+  template <typename Offsets>
+  static std::size_t misplaced_text(const Offsets& offsets,
+                                    std::uint64_t file_size) {
+    const auto count = static_cast<std::size_t>(offsets.size());
+    for (std::size_t i = 0; i < count; ++i) {
+      const std::uint64_t text = offsets[i];
+      if (text != 0 && (text < offset || text >= file_size)) {
+        return i;
+      }
+    }
+    return count;
+  }
+  // The offset in the file of a scene's entry in the text offsets
+  static std::size_t text_offset_field(std::size_t scene) {
+    return scene_string_offsets_offset + sizeof(std::uint32_t) * scene;
+  }
+  // Scene text has no section of its own, so text at this offset runs no
+  // further than the start of whatever follows it: a fixed-string section,
+  // the end of the blobs, or the end of a file of this size.
+  std::uint64_t text_end(std::uint64_t text, std::uint64_t file_size) const;
+};
+
+static_assert(sizeof(SCXFileHeader) == SCXFileHeader::size,
+              "SCXFileHeader did not pack correctly");
+
+// Table1, variable and asset name strings are each in a buffer of this size,
+// null-terminated unless they fill it
+static const std::uint32_t fixed_string_size = 0x20;
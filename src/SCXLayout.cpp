@@ -0,0 +1,29 @@
+#include "SCXLayout.hpp"
+
+#include <cstddef>
+using std::size_t;
+#include <cstdint>
+using std::uint64_t;
+
+#include <gsl/gsl>
+using gsl::narrow_cast;
+
+SCXLayout::SCXLayout()
+    : header_(),
+      file_size_(0),
+      scene_blobs_offset_(0),
+      variable_blobs_offset_(0),
+      blobs_end_(0) {}
+
+bool SCXLayout::locate(const SCXFileHeader& header, uint64_t file_size) {
+  if (!header.fits(file_size)) {
+    return false;
+  }
+  // Everything now fits in a size_t, as the file does
+  header_ = header;
+  file_size_ = narrow_cast<size_t>(file_size);
+  scene_blobs_offset_ = narrow_cast<size_t>(header.scene_blobs_offset());
+  variable_blobs_offset_ = narrow_cast<size_t>(header.variable_blobs_offset());
+  blobs_end_ = narrow_cast<size_t>(header.blobs_end());
+  return true;
+}
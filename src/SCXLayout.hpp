@@ -0,0 +1,156 @@
+#pragma once
+
+#include "SCXFormat.hpp"
+#include "Scene.hpp"
+#include "Variable.hpp"
+
+#include <type_traits>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <gsl/gsl>
+
+// The record views below index without bounds checks, as the SCXLayout which
+// hands them out has already checked every section lies within the file.
+// Building with SCX_CHECKED_VIEWS, as Debug builds do, checks each index too.
+#if defined(SCX_CHECKED_VIEWS)
+#define SCX_VIEW_EXPECTS(cond) Expects(cond)
+#else
+#define SCX_VIEW_EXPECTS(cond)
+#endif
+
+// count records of Size bytes, one after another
+template <typename Byte, std::size_t Size>
+class record_view {
+ public:
+  using record = gsl::multi_span<Byte, Size>;
+
+  record_view() : data_(nullptr), count_(0) {}
+  record_view(Byte* data, std::size_t count) : data_(data), count_(count) {}
+
+  std::size_t size() const { return count_; }
+  std::size_t size_bytes() const { return count_ * Size; }
+
+  record operator[](std::size_t index) const {
+    SCX_VIEW_EXPECTS(index < count_);
+    return record(data_ + index * Size, Size);
+  }
+
+ private:
+  Byte* data_;
+  std::size_t count_;
+};
+
+// count values of T, one after another
+template <typename T>
+class value_view {
+ public:
+  using value_type = T;
+
+  value_view() : data_(nullptr), count_(0) {}
+  value_view(T* data, std::size_t count) : data_(data), count_(count) {}
+
+  std::size_t size() const { return count_; }
+
+  T& operator[](std::size_t index) const {
+    SCX_VIEW_EXPECTS(index < count_);
+    return data_[index];
+  }
+
+ private:
+  T* data_;
+  std::size_t count_;
+};
+
+// Where each section of a file lies, worked out from its header once and
+// checked against the file's size, so the record loops need check nothing.
+// The views are of an image of the whole file, identifier and all, which must
+// be the size the layout was located for.
+class SCXLayout {
+ public:
+  using fixed_strings = SCXFileHeader::fixed_strings;
+
+  SCXLayout();
+
+  // Returns false, and leaves the layout alone, if any section would lie
+  // outside a file of file_size bytes. See SCXFileHeader::misfit.
+  bool locate(const SCXFileHeader& header, std::uint64_t file_size);
+
+  const SCXFileHeader& header() const { return header_; }
+  std::size_t file_size() const { return file_size_; }
+
+  std::size_t scene_count() const { return header_.scene_count; }
+  std::size_t count(fixed_strings which) const {
+    return header_.counts[which];
+  }
+
+  // Offsets in the file
+  std::size_t scene_blobs_offset() const { return scene_blobs_offset_; }
+  std::size_t variable_blobs_offset() const { return variable_blobs_offset_; }
+  std::size_t blobs_end() const { return blobs_end_; }
+  std::size_t strings_offset(fixed_strings which) const {
+    return header_.offsets[which];
+  }
+  // Table1 has one fixed string per record, the rest a pair
+  static std::size_t strings_per_record(fixed_strings which) {
+    return which == SCXFileHeader::table1 ? 1 : 2;
+  }
+  std::size_t strings_size(fixed_strings which) const {
+    return count(which) * strings_per_record(which) * fixed_string_size;
+  }
+  // Where scene text at offset must end, see SCXFileHeader::text_end
+  std::size_t text_end(std::size_t offset) const {
+    return gsl::narrow_cast<std::size_t>(header_.text_end(offset, file_size_));
+  }
+
+  template <typename Byte>
+  using word_view = value_view<
+      typename std::conditional<std::is_const<Byte>::value,
+                                const std::uint32_t, std::uint32_t>::type>;
+
+  template <typename Byte>
+  word_view<Byte> scene_text_offsets(gsl::multi_span<Byte> image) const {
+    return word_view<Byte>(
+        reinterpret_cast<typename word_view<Byte>::value_type*>(
+            at(image, SCXFileHeader::scene_string_offsets_offset)),
+        scene_count());
+  }
+  template <typename Byte>
+  record_view<Byte, Scene::blob_size> scene_blobs(
+      gsl::multi_span<Byte> image) const {
+    return record_view<Byte, Scene::blob_size>(at(image, scene_blobs_offset_),
+                                               scene_count());
+  }
+  template <typename Byte>
+  record_view<Byte, Variable::blob_size> variable_blobs(
+      gsl::multi_span<Byte> image) const {
+    return record_view<Byte, Variable::blob_size>(
+        at(image, variable_blobs_offset_), count(SCXFileHeader::variable));
+  }
+  // Each record's strings are together, so a pair is strings 2i and 2i + 1.
+  // An empty section's offset is not checked, so is not used.
+  template <typename Byte>
+  record_view<Byte, fixed_string_size> strings(gsl::multi_span<Byte> image,
+                                               fixed_strings which) const {
+    if (count(which) == 0) {
+      return record_view<Byte, fixed_string_size>();
+    }
+    return record_view<Byte, fixed_string_size>(
+        at(image, strings_offset(which)),
+        count(which) * strings_per_record(which));
+  }
+
+ private:
+  template <typename Byte>
+  Byte* at(gsl::multi_span<Byte> image, std::size_t offset) const {
+    Expects(static_cast<std::size_t>(image.size()) == file_size_);
+    return image.data() + offset;
+  }
+
+  SCXFileHeader header_;
+  std::size_t file_size_;
+  std::size_t scene_blobs_offset_;
+  std::size_t variable_blobs_offset_;
+  std::size_t blobs_end_;
+};
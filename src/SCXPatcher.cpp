@@ -0,0 +1,162 @@
+#include "SCXPatcher.hpp"
+
+#include "Cipher.hpp"
+
+#include <array>
+using std::array;
+#include <memory>
+using std::unique_ptr;
+#include <string>
+using std::string;
+#include <utility>
+using std::move;
+
+#include <cstddef>
+using std::size_t;
+using std::ptrdiff_t;
+#include <cstring>
+using std::memcmp;
+#include <cstdint>
+using std::uint32_t;
+using std::uint64_t;
+
+#include <gsl/gsl>
+using gsl::as_multi_span;
+using gsl::as_writeable_bytes;
+using gsl::byte;
+using gsl::narrow_cast;
+using gsl::multi_span;
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+using namespace boost::interprocess;
+
+namespace {
+// Whether text fits in a fixed string once encoded. Encoding text that does
+// not fails a contract check, which cannot be caught.
+bool fits(const FixedText& text, cp932::unmappable policy) {
+  return text.cp932_size(policy) <= fixed_string_size;
+}
+}
+
+SCXPatcher::SCXPatcher()
+    : region_(), bytes_(), header_(), unmappable_(cp932::unmappable::skip) {}
+
+SCXPatcher::~SCXPatcher() {}
+
+bool SCXPatcher::open(const string& fileName) try {
+  unique_ptr<mapped_region> region(new mapped_region(
+      file_mapping(fileName.c_str(), read_write), read_write));
+  multi_span<byte> bytes(static_cast<byte*>(region->get_address()),
+                         narrow_cast<ptrdiff_t>(region->get_size()));
+  if (region->get_size() < SCXFileHeader::offset + SCXFileHeader::size) {
+    return false;
+  }
+
+  const auto& ident = as_multi_span<SCXFileIdentifier>(
+      bytes.first<sizeof(SCXFileIdentifier)>())[0];
+  if (memcmp(&ident.fileprefix, "scx\0", 4)) {
+    return false;
+  }
+
+  SCXFileHeader header;
+  cipher::decrypt(bytes.subspan(SCXFileHeader::offset, SCXFileHeader::size),
+                  as_writeable_bytes(multi_span<SCXFileHeader>(&header, 1)), 0);
+  if (!header.fits(bytes.size_bytes())) {
+    return false;
+  }
+
+  region_ = move(region);
+  bytes_ = bytes;
+  header_ = header;
+  return true;
+} catch (...) {
+  return false;
+}
+
+bool SCXPatcher::flush() {
+  return region_ && region_->flush();
+}
+
+bool SCXPatcher::set_scene(size_t index, const Scene& scene) try {
+  if (index >= scene_count()) {
+    return false;
+  }
+
+  // Scene does not hold every byte of its blob, so the bytes it does not
+  // write keep the values they had
+  const uint64_t offset =
+      header_.scene_blobs_offset() + index * Scene::blob_size;
+  array<byte, Scene::blob_size> blob;
+  cipher::decrypt(
+      bytes_.subspan(narrow_cast<ptrdiff_t>(offset), Scene::blob_size), blob,
+      narrow_cast<size_t>(offset) - SCXFileHeader::offset);
+  scene.write_data(blob);
+  patch(offset, blob);
+  return true;
+} catch (...) {
+  return false;
+}
+
+bool SCXPatcher::set_table1(size_t index, const Table1Data& table1) try {
+  if (index >= table1_count() || !fits(table1.data, unmappable_)) {
+    return false;
+  }
+
+  array<byte, fixed_string_size> buffer;
+  table1.write_data(buffer, unmappable_);
+  patch(header_.offsets[SCXFileHeader::table1] + index * fixed_string_size,
+        buffer);
+  return true;
+} catch (...) {
+  return false;
+}
+
+bool SCXPatcher::set_variable(size_t index, const Variable& variable) try {
+  if (index >= variable_count() || !fits(variable.name, unmappable_) ||
+      !fits(variable.comment, unmappable_)) {
+    return false;
+  }
+
+  array<byte, fixed_string_size * 2> strings;
+  array<byte, Variable::blob_size> blob;
+  auto strings_out = multi_span<byte>(strings);
+  variable.write_data(strings_out.first<fixed_string_size>(),
+                      strings_out.last<fixed_string_size>(), blob,
+                      unmappable_);
+  patch(header_.offsets[SCXFileHeader::variable] +
+            index * fixed_string_size * 2,
+        strings);
+  patch(header_.variable_blobs_offset() + index * Variable::blob_size, blob);
+  return true;
+} catch (...) {
+  return false;
+}
+
+bool SCXPatcher::set_asset(SCXFileHeader::fixed_strings type, size_t index,
+                           const AssetName& asset) try {
+  if (index >= header_.counts[type] || !fits(asset.name, unmappable_) ||
+      !fits(asset.abbreviation, unmappable_)) {
+    return false;
+  }
+
+  array<byte, fixed_string_size * 2> strings;
+  auto strings_out = multi_span<byte>(strings);
+  asset.write_data(strings_out.first<fixed_string_size>(),
+                   strings_out.last<fixed_string_size>(), unmappable_);
+  patch(header_.offsets[type] + index * fixed_string_size * 2, strings);
+  return true;
+} catch (...) {
+  return false;
+}
+
+void SCXPatcher::patch(uint64_t offset, multi_span<const byte> plain) {
+  auto target = bytes_.subspan(narrow_cast<ptrdiff_t>(offset), plain.size());
+  const uint32_t before = cipher::checksum(target);
+  const uint32_t after = cipher::encrypt(
+      plain, target, narrow_cast<size_t>(offset) - SCXFileHeader::offset);
+
+  auto& ident = as_multi_span<SCXFileIdentifier>(
+      bytes_.first<sizeof(SCXFileIdentifier)>())[0];
+  ident.checksum += after - before;
+}
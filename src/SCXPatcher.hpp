@@ -0,0 +1,88 @@
+#pragma once
+
+#include "AssetName.hpp"
+#include "CP932.hpp"
+#include "SCXFormat.hpp"
+#include "Scene.hpp"
+#include "Table1Data.hpp"
+#include "Variable.hpp"
+
+#include <memory>
+#include <string>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <gsl/gsl>
+
+namespace boost {
+namespace interprocess {
+class mapped_region;
+}
+}
+
+// Overwrites fixed-width records of an SCX file in place. Only the bytes of
+// the record are encrypted and written, and the checksum is adjusted by the
+// difference, so the cost does not depend on the size of the file.
+// The checksum is not checked on open, so a file that was already corrupt
+// stays corrupt; use SCXFile::verify first if that matters.
+class SCXPatcher {
+ public:
+  SCXPatcher();
+  ~SCXPatcher();
+
+  bool open(const std::string& fileName);
+  // Writes the changes back to the file. Changes also reach the file once the
+  // SCXPatcher is destroyed or another file is opened.
+  bool flush();
+
+  std::size_t scene_count() const { return header_.scene_count; }
+  std::size_t table1_count() const {
+    return header_.counts[SCXFileHeader::table1];
+  }
+  std::size_t variable_count() const {
+    return header_.counts[SCXFileHeader::variable];
+  }
+  std::size_t bg_count() const { return header_.counts[SCXFileHeader::BG]; }
+  std::size_t chr_count() const { return header_.counts[SCXFileHeader::CHR]; }
+  std::size_t se_count() const { return header_.counts[SCXFileHeader::SE]; }
+  std::size_t bgm_count() const { return header_.counts[SCXFileHeader::BGM]; }
+
+  // As for SCXFile
+  void set_unmappable(cp932::unmappable policy) { unmappable_ = policy; }
+  cp932::unmappable unmappable() const { return unmappable_; }
+
+  // Each returns false if there is no such record, if the text cannot be
+  // encoded under the unmappable policy, or if it does not fit its fixed
+  // string once encoded. The file is then left as it was.
+
+  // Only the scene's blob is written. The text is not fixed-width, so
+  // scene.text is ignored and the scene keeps the text it had.
+  bool set_scene(std::size_t index, const Scene& scene);
+  bool set_table1(std::size_t index, const Table1Data& table1);
+  bool set_variable(std::size_t index, const Variable& variable);
+  bool set_bg(std::size_t index, const AssetName& asset) {
+    return set_asset(SCXFileHeader::BG, index, asset);
+  }
+  bool set_chr(std::size_t index, const AssetName& asset) {
+    return set_asset(SCXFileHeader::CHR, index, asset);
+  }
+  bool set_se(std::size_t index, const AssetName& asset) {
+    return set_asset(SCXFileHeader::SE, index, asset);
+  }
+  bool set_bgm(std::size_t index, const AssetName& asset) {
+    return set_asset(SCXFileHeader::BGM, index, asset);
+  }
+
+ private:
+  bool set_asset(SCXFileHeader::fixed_strings type, std::size_t index,
+                 const AssetName& asset);
+  // Encrypts plain over the file at offset, and adjusts the checksum
+  void patch(std::uint64_t offset, gsl::multi_span<const gsl::byte> plain);
+
+  std::unique_ptr<boost::interprocess::mapped_region> region_;
+  gsl::multi_span<gsl::byte> bytes_;
+  // Decrypted
+  SCXFileHeader header_;
+  cp932::unmappable unmappable_;
+};
@@ -0,0 +1,153 @@
+#include "SCXView.hpp"
+
+#include "Cipher.hpp"
+
+#include <memory>
+using std::make_shared;
+#include <string>
+using std::string;
+
+#include <cstddef>
+using std::size_t;
+using std::ptrdiff_t;
+#include <cstring>
+using std::memchr;
+using std::memcmp;
+using std::memcpy;
+#include <cstdint>
+using std::uint32_t;
+
+#include <gsl/gsl>
+using gsl::byte;
+using gsl::cstring_span;
+using gsl::multi_span;
+using gsl::narrow_cast;
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+using boost::interprocess::copy_on_write;
+using boost::interprocess::file_mapping;
+using boost::interprocess::mapped_region;
+using boost::interprocess::read_only;
+
+SCXView::SCXView() : owner_(), bytes_(), layout_() {}
+
+bool SCXView::read(const string& fileName) try {
+  // Private pages, so the image can be decrypted in place without a copy and
+  // without touching the file.
+  auto region = make_shared<mapped_region>(
+      file_mapping(fileName.c_str(), read_only), copy_on_write);
+  multi_span<byte> bytes(reinterpret_cast<byte*>(region->get_address()),
+                         narrow_cast<ptrdiff_t>(region->get_size()));
+  if (region->get_size() < SCXFileHeader::offset + SCXFileHeader::size) {
+    return false;
+  }
+
+  SCXFileIdentifier ident;
+  memcpy(&ident, bytes.data(), sizeof(ident));
+  if (memcmp(&ident.fileprefix, "scx\0", 4)) {
+    return false;
+  }
+  auto encrypted = bytes.subspan(SCXFileHeader::offset);
+  if (cipher::decrypt(encrypted, encrypted, 0) != ident.checksum) {
+    return false;
+  }
+
+  if (!locate(bytes)) {
+    return false;
+  }
+  owner_ = region;
+  return true;
+} catch (...) {
+  return false;
+}
+
+bool SCXView::view(multi_span<const byte> decrypted) {
+  if (static_cast<size_t>(decrypted.size_bytes()) <
+          SCXFileHeader::offset + SCXFileHeader::size ||
+      memcmp(decrypted.data(), "scx\0", 4)) {
+    return false;
+  }
+  if (!locate(decrypted)) {
+    return false;
+  }
+  owner_.reset();
+  return true;
+}
+
+bool SCXView::locate(multi_span<const byte> decrypted) {
+  SCXFileHeader header;
+  memcpy(&header, decrypted.data() + SCXFileHeader::offset, sizeof(header));
+  const auto size = static_cast<size_t>(decrypted.size_bytes());
+  SCXLayout layout;
+  if (!layout.locate(header, size)) {
+    return false;
+  }
+
+  // So text never starts outside the file
+  if (SCXFileHeader::misplaced_text(layout.scene_text_offsets(decrypted),
+                                    size) != layout.scene_count()) {
+    return false;
+  }
+
+  bytes_ = decrypted;
+  layout_ = layout;
+  return true;
+}
+
+SCXView::SceneRef::scene_jump_span SCXView::SceneRef::sceneJumpInfo(
+    size_t jump) const {
+  Expects(jump >= 1 && jump <= 4);
+  // After the ten uint16_t fields
+  return scene_jump_span(
+      blob_.data() + 10 * sizeof(std::uint16_t) +
+          (jump - 1) * Scene::scene_jump_blob_size,
+      Scene::scene_jump_blob_size);
+}
+
+cstring_span<> SCXView::SceneRef::text() const {
+  if (text_ == nullptr) {
+    return cstring_span<>();
+  }
+  const auto end =
+      static_cast<const char*>(memchr(text_, 0, text_limit_ - text_));
+  return cstring_span<>(text_, end != nullptr ? end : text_limit_);
+}
+
+SCXView::SceneRef SCXView::scene(size_t index) const {
+  Expects(index < scene_count());
+  const uint32_t offset = layout_.scene_text_offsets(bytes_)[index];
+  const auto chars = reinterpret_cast<const char*>(bytes_.data());
+  if (offset == 0) {
+    return SceneRef(layout_.scene_blobs(bytes_)[index], nullptr, nullptr);
+  }
+  return SceneRef(layout_.scene_blobs(bytes_)[index], chars + offset,
+                  chars + layout_.text_end(offset));
+}
+
+Table1Data::fixed_string_span SCXView::table1_string(size_t index) const {
+  Expects(index < table1_count());
+  return strings(SCXFileHeader::table1)[index];
+}
+
+SCXView::VariableRef SCXView::variable(size_t index) const {
+  Expects(index < variable_count());
+  const auto names = strings(SCXFileHeader::variable);
+  return VariableRef(names[2 * index], names[2 * index + 1],
+                     layout_.variable_blobs(bytes_)[index]);
+}
+
+SCXView::AssetRef SCXView::asset(SCXFileHeader::fixed_strings section,
+                                 size_t index) const {
+  Expects(index < layout_.count(section));
+  const auto names = strings(section);
+  return AssetRef(names[2 * index], names[2 * index + 1]);
+}
+
+cstring_span<> SCXView::fixed_string(
+    multi_span<const byte, fixed_string_size> string) {
+  const auto chars = reinterpret_cast<const char*>(string.data());
+  const auto end =
+      static_cast<const char*>(memchr(chars, 0, fixed_string_size));
+  return cstring_span<>(chars, end != nullptr ? end : chars + fixed_string_size);
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "AssetName.hpp"
+#include "SCXFormat.hpp"
+#include "SCXLayout.hpp"
+#include "Scene.hpp"
+#include "Table1Data.hpp"
+#include "Variable.hpp"
+
+#include <memory>
+#include <string>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <gsl/gsl>
+
+// A file's records read in place from its decrypted image. Nothing is decoded
+// into Scene and friends and nothing is allocated per record, so opening a
+// file costs the mapping and the decrypt, and the view holds about one copy
+// of it. Text is given as its CP932 bytes, see cp932::to_utf8 or LazyText.
+// Build an SCXFile from the view to change anything.
+// Safe to read from more than one thread at a time.
+class SCXView {
+ public:
+  SCXView();
+
+  // Maps the file into private pages, decrypts it there, and checks the
+  // checksum, the header and the scene text offsets. The view owns the
+  // mapping.
+  bool read(const std::string& fileName);
+  // Views a whole file which is already decrypted after its identifier, and
+  // must outlive the view. Checks the header and the scene text offsets, but
+  // cannot check the checksum.
+  bool view(gsl::multi_span<const gsl::byte> decrypted);
+
+  // A scene, with fields read from its blob as they are asked for
+  class SceneRef {
+   public:
+    std::uint16_t chapter() const { return field(0); }
+    std::uint16_t scene() const { return field(1); }
+    std::uint16_t command() const { return field(2); }
+    std::uint16_t unk1() const { return field(3); }
+    std::uint16_t unk2() const { return field(4); }
+    std::uint16_t chapterJump() const { return field(5); }
+    std::uint16_t sceneJump1() const { return field(6); }
+    std::uint16_t sceneJump2() const { return field(7); }
+    std::uint16_t sceneJump3() const { return field(8); }
+    std::uint16_t sceneJump4() const { return field(9); }
+    using scene_jump_span =
+        gsl::multi_span<const gsl::byte, Scene::scene_jump_blob_size>;
+    // jump is 1 to 4, as in the field names
+    scene_jump_span sceneJumpInfo(std::size_t jump) const;
+    std::uint32_t unk3() const { return field(10 + 4 * jump_fields); }
+
+    bool has_text() const { return text_ != nullptr; }
+    // Up to its null or the section which follows it, as SCXFile::read
+    // bounds it, and empty if the scene has no text
+    gsl::cstring_span<> text() const;
+
+    Scene::blob_span blob() const { return blob_; }
+
+   private:
+    friend class SCXView;
+    SceneRef(Scene::blob_span blob, const char* text, const char* text_limit)
+        : blob_(blob), text_(text), text_limit_(text_limit) {}
+
+    // Each jump blob is this many uint16_t
+    static const std::size_t jump_fields =
+        Scene::scene_jump_blob_size / sizeof(std::uint16_t);
+
+    // The index'th uint16_t of the blob
+    std::uint16_t field(std::size_t index) const {
+      std::uint16_t value;
+      std::memcpy(&value, blob_.data() + index * sizeof(value), sizeof(value));
+      return value;
+    }
+
+    Scene::blob_span blob_;
+    const char* text_;
+    // The start of the section after the text, which it cannot run past
+    const char* text_limit_;
+  };
+
+  // A pair of fixed strings and, for variables, a blob
+  class VariableRef {
+   public:
+    gsl::cstring_span<> name() const { return fixed_string(string1_); }
+    gsl::cstring_span<> comment() const { return fixed_string(string0_); }
+
+    // As Variable::read_data takes them
+    Variable::fixed_string_span string0() const { return string0_; }
+    Variable::fixed_string_span string1() const { return string1_; }
+    Variable::blob_span blob() const { return blob_; }
+
+   private:
+    friend class SCXView;
+    VariableRef(Variable::fixed_string_span string0,
+                Variable::fixed_string_span string1, Variable::blob_span blob)
+        : string0_(string0), string1_(string1), blob_(blob) {}
+
+    Variable::fixed_string_span string0_;
+    Variable::fixed_string_span string1_;
+    Variable::blob_span blob_;
+  };
+
+  class AssetRef {
+   public:
+    gsl::cstring_span<> name() const { return fixed_string(string0_); }
+    gsl::cstring_span<> abbreviation() const {
+      return fixed_string(string1_);
+    }
+
+    // As AssetName::read_data takes them
+    AssetName::fixed_string_span string0() const { return string0_; }
+    AssetName::fixed_string_span string1() const { return string1_; }
+
+   private:
+    friend class SCXView;
+    AssetRef(AssetName::fixed_string_span string0,
+             AssetName::fixed_string_span string1)
+        : string0_(string0), string1_(string1) {}
+
+    AssetName::fixed_string_span string0_;
+    AssetName::fixed_string_span string1_;
+  };
+
+  std::size_t scene_count() const { return layout_.scene_count(); }
+  std::size_t table1_count() const {
+    return layout_.count(SCXFileHeader::table1);
+  }
+  std::size_t variable_count() const {
+    return layout_.count(SCXFileHeader::variable);
+  }
+  std::size_t bg_count() const { return layout_.count(SCXFileHeader::BG); }
+  std::size_t chr_count() const { return layout_.count(SCXFileHeader::CHR); }
+  std::size_t se_count() const { return layout_.count(SCXFileHeader::SE); }
+  std::size_t bgm_count() const { return layout_.count(SCXFileHeader::BGM); }
+  // Voice file names are not stored in the file, so there are no accessors
+  // for them.
+  std::size_t voice_count() const {
+    return layout_.count(SCXFileHeader::VOICE);
+  }
+
+  SceneRef scene(std::size_t index) const;
+  gsl::cstring_span<> table1(std::size_t index) const {
+    return fixed_string(table1_string(index));
+  }
+  // As Table1Data::read_data takes it
+  Table1Data::fixed_string_span table1_string(std::size_t index) const;
+  VariableRef variable(std::size_t index) const;
+  AssetRef bg(std::size_t index) const {
+    return asset(SCXFileHeader::BG, index);
+  }
+  AssetRef chr(std::size_t index) const {
+    return asset(SCXFileHeader::CHR, index);
+  }
+  AssetRef se(std::size_t index) const {
+    return asset(SCXFileHeader::SE, index);
+  }
+  AssetRef bgm(std::size_t index) const {
+    return asset(SCXFileHeader::BGM, index);
+  }
+
+  // The decrypted file, from its identifier on
+  gsl::multi_span<const gsl::byte> bytes() const { return bytes_; }
+  // Keeps bytes() alive if the view owns them, otherwise null
+  const std::shared_ptr<const void>& owner() const { return owner_; }
+
+ private:
+  // Up to the first null in a fixed string, or all of it
+  static gsl::cstring_span<> fixed_string(
+      gsl::multi_span<const gsl::byte, fixed_string_size> string);
+
+  bool locate(gsl::multi_span<const gsl::byte> decrypted);
+  record_view<const gsl::byte, fixed_string_size> strings(
+      SCXFileHeader::fixed_strings section) const {
+    return layout_.strings(bytes_, section);
+  }
+  AssetRef asset(SCXFileHeader::fixed_strings section,
+                 std::size_t index) const;
+
+  std::shared_ptr<const void> owner_;
+  gsl::multi_span<const gsl::byte> bytes_;
+  SCXLayout layout_;
+};
@@ -1,23 +1,55 @@
 ﻿#include "Scene.hpp"
 
-#include <boost/locale.hpp>
-using boost::locale::conv::to_utf;
-using boost::locale::conv::from_utf;
+#include "LazyText.hpp"
+#include "SceneJumpPool.hpp"
 
 #include <algorithm>
+using std::all_of;
 using std::copy;
-
-#include <string>
-using std::string;
-
+#include <array>
+using std::array;
+#include <memory>
+using std::make_shared;
+using std::shared_ptr;
+#include <utility>
+using std::move;
+
+#include <cstddef>
+using std::size_t;
 #include <cstdint>
+using std::uint32_t;
 using std::uint8_t;
 
-void Scene::read_data(gsl::czstring<> cp932text, blob_span data) {
-  // String is null-terminated and encoded in Windows code-page 932, which
-  // is known as "Shift_JIS" only within the MS API, and as "CP932" everywhere
-  // except non-Windows ICU. msys2's mingw64 build of boost appears to be
-  // using non-Windows ICU as its backend, so we can't use that name.
+const size_t Scene::scene_jump_count;
+
+namespace {
+const Scene::scene_jump_blob no_scene_jump = {};
+}
+
+Scene::Scene()
+    : text(),
+      chapter(0),
+      scene(0),
+      command(0),
+      unk1(0),
+      unk2(0),
+      chapterJump(0),
+      sceneJump1(0),
+      sceneJump2(0),
+      sceneJump3(0),
+      sceneJump4(0),
+      unk3(0),
+      jumps_present_(0),
+      jump_indices_(),
+      jump_pool_() {}
+
+void Scene::read_data(gsl::multi_span<const char> cp932text, blob_span data,
+                      std::shared_ptr<const void> owner,
+                      const shared_ptr<SceneJumpPool>& jumps) {
+  // String is encoded in Windows code-page 932, which is known as "Shift_JIS"
+  // only within the MS API, and as "CP932" everywhere except non-Windows ICU.
+  // msys2's mingw64 build of boost appears to be using non-Windows ICU as its
+  // backend, so we can't use that name.
   // After much experimentation, it appears both the WindowsAPI-backed
   // boost::locale::conv in Visual Studio, and the ICU-backed version in
   // msys2's mingw64, agree on "windows-932".
@@ -38,14 +70,64 @@ void Scene::read_data(gsl::czstring<> cp932text, blob_span data) {
   // may occur: https://support.microsoft.com/en-us/kb/170559 according to
   // http://www.unicode.org/Public/MAPPINGS/VENDORS/MICSFT/WindowsBestFit/bestfit932.txt
 
-  string cp932data;
-  if (cp932text != nullptr) {
-    while (*cp932text != '\0') {
-      cp932data.push_back(*cp932text++);
+  if (!cp932text.empty()) {
+    text = LazyText::from_cp932(cp932text, std::move(owner));
+  }
+
+  read_blob(data, jumps);
+}
+
+void Scene::read_data(const char* cp932text, blob_span data,
+                      std::shared_ptr<const TextArena> text_arena,
+                      const shared_ptr<SceneJumpPool>& jumps) {
+  text = LazyText::from_cp932(cp932text, std::move(text_arena));
+  read_blob(data, jumps);
+}
+
+const Scene::scene_jump_blob& Scene::sceneJumpInfo(size_t jump) const {
+  if (!has_sceneJumpInfo(jump)) {
+    return no_scene_jump;
+  }
+  return (*jump_pool_)[jump_indices_[jump - 1]];
+}
+
+bool Scene::has_sceneJumpInfo(size_t jump) const {
+  Expects(jump >= 1 && jump <= scene_jump_count);
+  return (jumps_present_ & (1u << (jump - 1))) != 0;
+}
+
+void Scene::set_sceneJumpInfo(size_t jump, const scene_jump_blob& info) {
+  Expects(jump >= 1 && jump <= scene_jump_count);
+  auto value = [this, jump, &info](size_t n) -> const scene_jump_blob& {
+    return n == jump ? info : sceneJumpInfo(n);
+  };
+  uint8_t present = 0;
+  for (size_t n = 1; n <= scene_jump_count; ++n) {
+    if (value(n) != no_scene_jump) {
+      present |= 1u << (n - 1);
+    }
+  }
+  if (!present) {
+    jumps_present_ = 0;
+    jump_pool_.reset();
+    return;
+  }
+
+  // The pool may be shared, so this scene's blobs move to one of its own
+  auto pool = make_shared<SceneJumpPool>();
+  array<uint32_t, scene_jump_count> indices = {};
+  for (size_t n = 1; n <= scene_jump_count; ++n) {
+    if (present & (1u << (n - 1))) {
+      indices[n - 1] = pool->intern(value(n));
     }
-    text = to_utf<char>(cp932data, "windows-932");
   }
+  jump_indices_ = indices;
+  jumps_present_ = present;
+  jump_pool_ = move(pool);
+}
 
+void Scene::read_blob(blob_span data,
+                      const shared_ptr<SceneJumpPool>& jumps) {
   // 10 x uint16_t, 8 known and two mystery
   auto known =
       gsl::as_multi_span<const uint16_t>(data.first<sizeof(uint16_t) * 10>());
@@ -70,24 +152,31 @@ void Scene::read_data(gsl::czstring<> cp932text, blob_span data) {
                          gsl::dim<4>(), gsl::dim<scene_jump_blob_size>());
   buffer = buffer.subspan(scene_jumps.size_bytes());
 
-  auto scene_jumps1 = scene_jumps[0];
-  copy(scene_jumps1.cbegin(), scene_jumps1.cend(), sceneJumpInfo1.begin());
-
-  auto scene_jumps2 = scene_jumps[1];
-  copy(scene_jumps2.cbegin(), scene_jumps2.cend(), sceneJumpInfo2.begin());
-
-  auto scene_jumps3 = scene_jumps[2];
-  copy(scene_jumps3.cbegin(), scene_jumps3.cend(), sceneJumpInfo3.begin());
-
-  auto scene_jumps4 = scene_jumps[3];
-  copy(scene_jumps4.cbegin(), scene_jumps4.cend(), sceneJumpInfo4.begin());
+  // Only those which are not all zero are kept
+  shared_ptr<SceneJumpPool> pool = jumps;
+  jumps_present_ = 0;
+  for (size_t n = 0; n < scene_jump_count; ++n) {
+    auto scene_jump = scene_jumps[n];
+    if (all_of(scene_jump.cbegin(), scene_jump.cend(),
+               [](gsl::byte b) { return b == static_cast<gsl::byte>(0); })) {
+      continue;
+    }
+    if (!pool) {
+      pool = make_shared<SceneJumpPool>();
+    }
+    scene_jump_blob value;
+    copy(scene_jump.cbegin(), scene_jump.cend(), value.begin());
+    jump_indices_[n] = pool->intern(value);
+    jumps_present_ |= 1u << n;
+  }
+  jump_pool_ = jumps_present_ ? move(pool) : nullptr;
 
   // A trailing uint16_t, also of mystery
   auto unknown = gsl::as_multi_span<const uint16_t>(buffer);
   unk3 = unknown[0];
 }
 
-std::unique_ptr<std::string> Scene::write_data(blob_span_out data) const {
+void Scene::write_data(blob_span_out data) const {
   // See read_data
   auto known =
       gsl::as_multi_span<uint16_t>(data.first<sizeof(uint16_t) * 10>());
@@ -110,24 +199,12 @@ std::unique_ptr<std::string> Scene::write_data(blob_span_out data) const {
                          gsl::dim<4>(), gsl::dim<scene_jump_blob_size>());
   buffer = buffer.subspan(scene_jumps.size_bytes());
 
-  auto scene_jumps1 = scene_jumps[0];
-  copy(sceneJumpInfo1.cbegin(), sceneJumpInfo1.cend(), scene_jumps1.begin());
-
-  auto scene_jumps2 = scene_jumps[1];
-  copy(sceneJumpInfo2.cbegin(), sceneJumpInfo2.cend(), scene_jumps2.begin());
-
-  auto scene_jumps3 = scene_jumps[2];
-  copy(sceneJumpInfo3.cbegin(), sceneJumpInfo3.cend(), scene_jumps3.begin());
-
-  auto scene_jumps4 = scene_jumps[3];
-  copy(sceneJumpInfo4.cbegin(), sceneJumpInfo4.cend(), scene_jumps4.begin());
+  for (size_t n = 0; n < scene_jump_count; ++n) {
+    const auto& value = sceneJumpInfo(n + 1);
+    auto scene_jump = scene_jumps[n];
+    copy(value.cbegin(), value.cend(), scene_jump.begin());
+  }
 
   auto unknown = gsl::as_multi_span<uint16_t>(buffer);
   unknown[0] = unk3;
-
-  if (text.empty()) {
-    return nullptr;
-  }
-
-  return std::make_unique<string>(from_utf<char>(text, "windows-932"));
 }
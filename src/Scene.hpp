@@ -1,6 +1,13 @@
+#pragma once
+
+#include "LazyText.hpp"
+#include "SceneJumpPool.hpp"
+
 #include <array>
+#include <memory>
 #include <string>
 
+#include <cstddef>
 #include <cstdint>
 
 #include <gsl/gsl>
@@ -9,18 +16,39 @@ struct Scene {
  public:
   static const uint32_t blob_size = 0xd8;
 
+  // All fields zero, and no text
+  Scene();
+
   // Reading API
   using blob_span = gsl::multi_span<const gsl::byte, blob_size>;
-  void read_data(gsl::czstring<> cp932text, blob_span data);
+  // cp932text is the text without its null, and empty if there is none. With
+  // an owner, it is kept rather than decoded. See LazyText.
+  // Any scene jump blobs which are not all zero are kept in jumps, if given,
+  // so the scenes of one file share them.
+  void read_data(gsl::multi_span<const char> cp932text, blob_span data,
+                 std::shared_ptr<const void> owner = nullptr,
+                 const std::shared_ptr<SceneJumpPool>& jumps = nullptr);
+  // As above, with cp932text in the region of text, which bounds and decodes
+  // it
+  void read_data(const char* cp932text, blob_span data,
+                 std::shared_ptr<const TextArena> text_arena,
+                 const std::shared_ptr<SceneJumpPool>& jumps = nullptr);
 
-  // Writing API
+  // Writing API. The text is not fixed-width, so is written apart from the
+  // blob, see LazyText::to_cp932.
   using blob_span_out = gsl::multi_span<gsl::byte, blob_size>;
-  std::unique_ptr<std::string> write_data(blob_span_out data) const;
+  void write_data(blob_span_out data) const;
+
+  static const size_t scene_jump_blob_size = SceneJumpPool::blob_size;
+  using scene_jump_blob = SceneJumpPool::blob;
 
-  static const size_t scene_jump_blob_size = 0x30;
-  using scene_jump_blob = std::array<gsl::byte, scene_jump_blob_size>;
+  // The blob after sceneJump1 to sceneJump4, by number. Most are all zero,
+  // so are not stored.
+  const scene_jump_blob& sceneJumpInfo(std::size_t jump) const;
+  bool has_sceneJumpInfo(std::size_t jump) const;
+  void set_sceneJumpInfo(std::size_t jump, const scene_jump_blob& info);
 
-  std::string text;  // utf-8 encoded
+  LazyText text;  // utf-8 encoded
   std::uint16_t chapter;
   std::uint16_t scene;
   std::uint16_t command;
@@ -28,12 +56,21 @@ struct Scene {
   std::uint16_t unk2;
   std::uint16_t chapterJump;
   std::uint16_t sceneJump1;
-  scene_jump_blob sceneJumpInfo1;
   std::uint16_t sceneJump2;
-  scene_jump_blob sceneJumpInfo2;
   std::uint16_t sceneJump3;
-  scene_jump_blob sceneJumpInfo3;
   std::uint16_t sceneJump4;
-  scene_jump_blob sceneJumpInfo4;
   std::uint32_t unk3;
+
+ private:
+  static const std::size_t scene_jump_count = 4;
+
+  void read_blob(blob_span data, const std::shared_ptr<SceneJumpPool>& jumps);
+
+  // Bit n is set if blob n + 1 is not all zero, and so is in jump_pool_ at
+  // jump_indices_[n]
+  std::uint8_t jumps_present_;
+  std::array<std::uint32_t, scene_jump_count> jump_indices_;
+  // Null unless a blob is present. Shared by the scenes read from one file,
+  // so set_sceneJumpInfo leaves it alone.
+  std::shared_ptr<const SceneJumpPool> jump_pool_;
 };
@@ -0,0 +1,20 @@
+#include "SceneJumpPool.hpp"
+
+#include <cstddef>
+using std::size_t;
+#include <cstdint>
+using std::uint32_t;
+
+#include <gsl/gsl>
+using gsl::narrow_cast;
+
+const size_t SceneJumpPool::blob_size;
+
+uint32_t SceneJumpPool::intern(const blob& value) {
+  const auto index = narrow_cast<uint32_t>(blobs_.size());
+  auto inserted = indices_.emplace(value, index);
+  if (inserted.second) {
+    blobs_.push_back(&inserted.first->first);
+  }
+  return inserted.first->second;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <array>
+#include <map>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <gsl/gsl>
+
+// One copy of each distinct scene jump blob added to it. The scenes read from
+// a file refer to their blobs in its pool by index, as most are all zero, and
+// the rest often repeat.
+// Not safe to use from one thread while another adds to it.
+class SceneJumpPool {
+ public:
+  static const std::size_t blob_size = 0x30;
+  using blob = std::array<gsl::byte, blob_size>;
+
+  // The index of value, which counts up from 0 in the order the blobs were
+  // first added
+  std::uint32_t intern(const blob& value);
+  const blob& operator[](std::uint32_t index) const { return *blobs_[index]; }
+
+  // Distinct blobs
+  std::size_t size() const { return blobs_.size(); }
+
+ private:
+  // Nodes stay where they are as the map grows, so blobs_ stays valid
+  std::map<blob, std::uint32_t> indices_;
+  std::vector<const blob*> blobs_;
+};
@@ -0,0 +1,146 @@
+#include "SceneTable.hpp"
+
+#include <utility>
+using std::move;
+#include <vector>
+using std::vector;
+
+#include <cstddef>
+using std::size_t;
+#include <cstdint>
+using std::uint16_t;
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SCX_SCENE_TABLE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(SCX_SCENE_TABLE_SSE2)
+namespace {
+
+__m128i load8(const vector<uint16_t>& column, size_t i) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(&column[i]));
+}
+
+// Adds the index of each of the eight uint16_t a _mm_movemask_epi8 mask of
+// comparisons from first says matched
+void add_matches(unsigned mask, size_t first, vector<size_t>& indices) {
+  // Most blocks have no match at all
+  if (mask == 0) {
+    return;
+  }
+  for (size_t j = 0; j < 8; ++j) {
+    if (mask & (1u << (j * 2))) {
+      indices.push_back(first + j);
+    }
+  }
+}
+}
+#endif
+
+void SceneTable::reserve(size_t count) {
+  text.reserve(count);
+  chapter.reserve(count);
+  scene.reserve(count);
+  command.reserve(count);
+  unk1.reserve(count);
+  unk2.reserve(count);
+  chapterJump.reserve(count);
+  sceneJump1.reserve(count);
+  sceneJumpInfo1.reserve(count);
+  sceneJump2.reserve(count);
+  sceneJumpInfo2.reserve(count);
+  sceneJump3.reserve(count);
+  sceneJumpInfo3.reserve(count);
+  sceneJump4.reserve(count);
+  sceneJumpInfo4.reserve(count);
+  unk3.reserve(count);
+}
+
+void SceneTable::push_back(const Scene& row) {
+  Scene copy = row;
+  push_back(move(copy));
+}
+
+void SceneTable::push_back(Scene&& row) {
+  text.push_back(move(row.text));
+  chapter.push_back(row.chapter);
+  scene.push_back(row.scene);
+  command.push_back(row.command);
+  unk1.push_back(row.unk1);
+  unk2.push_back(row.unk2);
+  chapterJump.push_back(row.chapterJump);
+  sceneJump1.push_back(row.sceneJump1);
+  sceneJumpInfo1.push_back(row.sceneJumpInfo(1));
+  sceneJump2.push_back(row.sceneJump2);
+  sceneJumpInfo2.push_back(row.sceneJumpInfo(2));
+  sceneJump3.push_back(row.sceneJump3);
+  sceneJumpInfo3.push_back(row.sceneJumpInfo(3));
+  sceneJump4.push_back(row.sceneJump4);
+  sceneJumpInfo4.push_back(row.sceneJumpInfo(4));
+  unk3.push_back(row.unk3);
+}
+
+Scene SceneTable::scene_at(size_t index) const {
+  Scene row;
+  row.text = text[index];
+  row.chapter = chapter[index];
+  row.scene = scene[index];
+  row.command = command[index];
+  row.unk1 = unk1[index];
+  row.unk2 = unk2[index];
+  row.chapterJump = chapterJump[index];
+  row.sceneJump1 = sceneJump1[index];
+  row.set_sceneJumpInfo(1, sceneJumpInfo1[index]);
+  row.sceneJump2 = sceneJump2[index];
+  row.set_sceneJumpInfo(2, sceneJumpInfo2[index]);
+  row.sceneJump3 = sceneJump3[index];
+  row.set_sceneJumpInfo(3, sceneJumpInfo3[index]);
+  row.sceneJump4 = sceneJump4[index];
+  row.set_sceneJumpInfo(4, sceneJumpInfo4[index]);
+  row.unk3 = unk3[index];
+  return row;
+}
+
+vector<size_t> SceneTable::select(const vector<uint16_t>& column,
+                                  uint16_t value) {
+  vector<size_t> indices;
+  size_t i = 0;
+#if defined(SCX_SCENE_TABLE_SSE2)
+  const __m128i wanted = _mm_set1_epi16(static_cast<short>(value));
+  for (; i + 8 <= column.size(); i += 8) {
+    const __m128i matches = _mm_cmpeq_epi16(load8(column, i), wanted);
+    add_matches(_mm_movemask_epi8(matches), i, indices);
+  }
+#endif
+  for (; i < column.size(); ++i) {
+    if (column[i] == value) {
+      indices.push_back(i);
+    }
+  }
+  return indices;
+}
+
+vector<size_t> SceneTable::select(uint16_t chapter_number,
+                                  uint16_t command_number) const {
+  vector<size_t> indices;
+  size_t i = 0;
+#if defined(SCX_SCENE_TABLE_SSE2)
+  const __m128i wanted_chapter =
+      _mm_set1_epi16(static_cast<short>(chapter_number));
+  const __m128i wanted_command =
+      _mm_set1_epi16(static_cast<short>(command_number));
+  for (; i + 8 <= size(); i += 8) {
+    const __m128i matches =
+        _mm_and_si128(_mm_cmpeq_epi16(load8(chapter, i), wanted_chapter),
+                      _mm_cmpeq_epi16(load8(command, i), wanted_command));
+    add_matches(_mm_movemask_epi8(matches), i, indices);
+  }
+#endif
+  for (; i < size(); ++i) {
+    if (chapter[i] == chapter_number && command[i] == command_number) {
+      indices.push_back(i);
+    }
+  }
+  return indices;
+}
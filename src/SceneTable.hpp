@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Scene.hpp"
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// The scenes of a file a field at a time rather than a record at a time, so
+// a scan over one or two fields touches only those, packed together.
+// Each column holds the field of the same name in Scene, with sceneJumpInfo1
+// to 4 holding Scene::sceneJumpInfo(1) to (4). All columns are the same
+// length.
+struct SceneTable {
+ public:
+  void reserve(std::size_t count);
+  void push_back(const Scene& scene);
+  void push_back(Scene&& scene);
+
+  std::size_t size() const { return chapter.size(); }
+  bool empty() const { return chapter.empty(); }
+  // Gathers a row back into a Scene
+  Scene scene_at(std::size_t index) const;
+
+  // Indices of the scenes whose field in column is value, in order
+  static std::vector<std::size_t> select(
+      const std::vector<std::uint16_t>& column, std::uint16_t value);
+  // Indices of the scenes in chapter_number with command_number, in order
+  std::vector<std::size_t> select(std::uint16_t chapter_number,
+                                  std::uint16_t command_number) const;
+
+  std::vector<LazyText> text;
+  std::vector<std::uint16_t> chapter;
+  std::vector<std::uint16_t> scene;
+  std::vector<std::uint16_t> command;
+  std::vector<std::uint16_t> unk1;
+  std::vector<std::uint16_t> unk2;
+  std::vector<std::uint16_t> chapterJump;
+  std::vector<std::uint16_t> sceneJump1;
+  std::vector<Scene::scene_jump_blob> sceneJumpInfo1;
+  std::vector<std::uint16_t> sceneJump2;
+  std::vector<Scene::scene_jump_blob> sceneJumpInfo2;
+  std::vector<std::uint16_t> sceneJump3;
+  std::vector<Scene::scene_jump_blob> sceneJumpInfo3;
+  std::vector<std::uint16_t> sceneJump4;
+  std::vector<Scene::scene_jump_blob> sceneJumpInfo4;
+  std::vector<std::uint32_t> unk3;
+};
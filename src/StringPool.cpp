@@ -0,0 +1,41 @@
+#include "StringPool.hpp"
+
+#include <string>
+using std::string;
+#include <utility>
+using std::move;
+
+#include <cstddef>
+using std::size_t;
+#include <cstdint>
+using std::uint32_t;
+
+#include <gsl/gsl>
+using gsl::narrow_cast;
+
+StringPool::handle StringPool::intern(string text) {
+  const auto id = narrow_cast<uint32_t>(entries_.size());
+  auto inserted = entries_.insert(entry{move(text), id});
+  if (inserted.second) {
+    by_id_.push_back(&*inserted.first);
+  }
+  return handle(&*inserted.first);
+}
+
+StringPool::handle StringPool::find(string text) const {
+  const auto found = entries_.find(entry{move(text), 0});
+  return found != entries_.end() ? handle(&*found) : handle();
+}
+
+StringPool::handle StringPool::at(uint32_t id) const {
+  Expects(id < by_id_.size());
+  return handle(by_id_[id]);
+}
+
+size_t StringPool::text_bytes() const {
+  size_t bytes = 0;
+  for (const auto& value : entries_) {
+    bytes += value.text.size();
+  }
+  return bytes;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// One copy of each distinct string added to it. Text which is the same is
+// then shared, and can be told apart from other text by id alone.
+// Not safe to add to from more than one thread at a time.
+class StringPool {
+ private:
+  struct entry {
+    std::string text;
+    std::uint32_t id;
+  };
+
+ public:
+  // A string in a pool. Handles to the same text in the same pool compare
+  // equal without looking at the text.
+  class handle {
+   public:
+    handle() : entry_(nullptr) {}
+
+    explicit operator bool() const { return entry_ != nullptr; }
+    // Counts up from 0 in the order the strings were first added
+    std::uint32_t id() const { return entry_->id; }
+    const std::string& str() const { return entry_->text; }
+
+    friend bool operator==(handle lhs, handle rhs) {
+      return lhs.entry_ == rhs.entry_;
+    }
+    friend bool operator!=(handle lhs, handle rhs) { return !(lhs == rhs); }
+
+   private:
+    friend class StringPool;
+    explicit handle(const entry* found) : entry_(found) {}
+
+    const entry* entry_;
+  };
+
+  // owner is kept alive as long as the pool. SCXFile passes the file's image,
+  // which text added to the pool may still refer to.
+  explicit StringPool(std::shared_ptr<const void> owner = nullptr)
+      : owner_(std::move(owner)), entries_(), by_id_() {}
+
+  handle intern(std::string text);
+  // The text in the pool, or a null handle if it has not been added
+  handle find(std::string text) const;
+  // The text added with id, which must be less than size()
+  handle at(std::uint32_t id) const;
+
+  // Distinct strings
+  std::size_t size() const { return entries_.size(); }
+  // Bytes of text held, not counting any overhead
+  std::size_t text_bytes() const;
+
+ private:
+  struct entry_hash {
+    std::size_t operator()(const entry& value) const {
+      return std::hash<std::string>()(value.text);
+    }
+  };
+  struct entry_equal {
+    bool operator()(const entry& lhs, const entry& rhs) const {
+      return lhs.text == rhs.text;
+    }
+  };
+
+  std::shared_ptr<const void> owner_;
+  // Nodes stay where they are as the set grows, so handles stay valid
+  std::unordered_set<entry, entry_hash, entry_equal> entries_;
+  // Each entry, by id, for records which keep only the id
+  std::vector<const entry*> by_id_;
+};
@@ -1,3 +1,7 @@
+#pragma once
+
+#include "FixedText.hpp"
+
 #include <string>
 
 #include <cstdint>
@@ -12,8 +16,9 @@ struct Table1Data {
 
   // Writing API
   using fixed_string_span_out = gsl::multi_span<gsl::byte, 0x20>;
-  void write_data(fixed_string_span_out string) const;
+  void write_data(fixed_string_span_out string,
+                  cp932::unmappable policy = cp932::unmappable::skip) const;
 
   // utf-8 encoded, I have no idea what this class represents
-  std::string data;
+  FixedText data;
 };
@@ -0,0 +1,86 @@
+#include "TextArena.hpp"
+
+#include "CP932.hpp"
+
+#include <algorithm>
+using std::lower_bound;
+#include <memory>
+using std::shared_ptr;
+#include <mutex>
+using std::call_once;
+#include <utility>
+using std::move;
+using std::pair;
+
+#include <cstddef>
+using std::ptrdiff_t;
+using std::size_t;
+#include <cstring>
+using std::memchr;
+
+#include <gsl/gsl>
+using gsl::multi_span;
+using gsl::narrow_cast;
+
+TextArena::TextArena(multi_span<const char> cp932,
+                     shared_ptr<const void> owner)
+    : owner_(move(owner)),
+      cp932_(cp932),
+      indexed_(),
+      nulls_(),
+      decoded_(),
+      utf8_(),
+      starts_() {}
+
+multi_span<const char> TextArena::string_at(const char* cp932text) const {
+  Expects(contains(cp932text));
+  call_once(indexed_, [this] { index(); });
+
+  const size_t offset = cp932text - cp932_.data();
+  const auto null = lower_bound(nulls_.cbegin(), nulls_.cend(), offset);
+  const size_t end = null != nulls_.cend() ? *null : cp932_.size();
+  return multi_span<const char>(cp932text,
+                                narrow_cast<ptrdiff_t>(end - offset));
+}
+
+bool TextArena::find(const char* cp932text, const char*& utf8,
+                     size_t& utf8_size) const {
+  if (!contains(cp932text)) {
+    return false;
+  }
+  call_once(decoded_, [this] { decode(); });
+
+  const size_t offset = cp932text - cp932_.data();
+  auto found = lower_bound(
+      starts_.cbegin(), starts_.cend(), offset,
+      [](const pair<size_t, size_t>& start, size_t value) {
+        return start.first < value;
+      });
+  if (found == starts_.cend() || found->first != offset) {
+    return false;
+  }
+
+  const size_t end =
+      found + 1 != starts_.cend() ? (found + 1)->second : utf8_.size();
+  utf8 = utf8_.data() + found->second;
+  // Less the null
+  utf8_size = end - found->second - 1;
+  return true;
+}
+
+void TextArena::index() const {
+  const char* data = cp932_.data();
+  const size_t size = cp932_.size();
+  for (size_t i = 0; i < size; ++i) {
+    const auto found = static_cast<const char*>(memchr(data + i, 0, size - i));
+    if (found == nullptr) {
+      break;
+    }
+    i = found - data;
+    nulls_.push_back(i);
+  }
+}
+
+void TextArena::decode() const {
+  utf8_ = cp932::to_utf8_strings(cp932_, starts_);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+
+#include <gsl/gsl>
+
+// A region of null-terminated CP932 strings, such as the scene text, which is
+// decoded to UTF-8 all at once the first time any of it is asked for. Every
+// string then lives in the one buffer, so text taken from the region costs
+// neither a conversion nor an allocation of its own.
+// Safe to use from more than one thread.
+class TextArena {
+ public:
+  // owner must keep the region alive
+  TextArena(gsl::multi_span<const char> cp932,
+            std::shared_ptr<const void> owner);
+
+  gsl::multi_span<const char> cp932() const { return cp932_; }
+  bool contains(const char* cp932text) const {
+    return cp932text >= cp932_.data() &&
+           cp932text < cp932_.data() + cp932_.size();
+  }
+
+  // The CP932 string at cp932text, without its null, which ends at the next
+  // null or else the end of the region. cp932text must be in the region, but
+  // need not be the start of a string. The end of every string in the region
+  // is found the first time this is called, in one pass.
+  gsl::multi_span<const char> string_at(const char* cp932text) const;
+  // Whether a string starts at cp932text, so its UTF-8 can be found
+  bool starts_string(const char* cp932text) const {
+    return contains(cp932text) &&
+           (cp932text == cp932_.data() || cp932text[-1] == '\0');
+  }
+
+  // Finds the UTF-8 for the string starting at cp932text, which is null
+  // terminated. Fails if no string in the region starts there.
+  bool find(const char* cp932text, const char*& utf8,
+            std::size_t& utf8_size) const;
+
+ private:
+  void index() const;
+  void decode() const;
+
+  std::shared_ptr<const void> owner_;
+  gsl::multi_span<const char> cp932_;
+
+  mutable std::once_flag indexed_;
+  // Where each null is in cp932_, in order
+  mutable std::vector<std::size_t> nulls_;
+
+  mutable std::once_flag decoded_;
+  mutable std::string utf8_;
+  // Where each string starts in cp932_ and in utf8_, in order
+  mutable std::vector<std::pair<std::size_t, std::size_t>> starts_;
+};
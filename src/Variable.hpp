@@ -1,3 +1,7 @@
+#pragma once
+
+#include "FixedText.hpp"
+
 #include <array>
 #include <string>
 
@@ -19,10 +23,11 @@ struct Variable {
   using fixed_string_span_out = gsl::multi_span<gsl::byte, 0x20>;
   using blob_span_out = gsl::multi_span<gsl::byte, blob_size>;
   void write_data(fixed_string_span_out string0, fixed_string_span_out string1,
-                  blob_span_out data) const;
+                  blob_span_out data,
+                  cp932::unmappable policy = cp932::unmappable::skip) const;
 
   // utf-8 encoded
-  std::string name;
-  std::string comment;
+  FixedText name;
+  FixedText comment;
   std::array<gsl::byte, blob_size> info_blob;
 };
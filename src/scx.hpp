@@ -1 +1,6 @@
+#pragma once
+
+#include "SCXDecoder.hpp"
 #include "SCXFile.hpp"
+#include "SCXPatcher.hpp"
+#include "SCXView.hpp"
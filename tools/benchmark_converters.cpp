@@ -0,0 +1,227 @@
+#include <chrono>
+using std::chrono::duration;
+using std::chrono::steady_clock;
+#include <functional>
+using std::function;
+#include <iomanip>
+using std::fixed;
+using std::setprecision;
+using std::setw;
+#include <iostream>
+using std::cerr;
+using std::cout;
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+
+#include <cstddef>
+using std::size_t;
+
+#include <boost/locale.hpp>
+
+#if defined(SCX_WITH_ICU)
+#include <unicode/ucnv.h>
+#endif
+
+#if defined(SCX_WITH_ICONV)
+#include <iconv.h>
+#endif
+
+#include "CP932.hpp"
+#include "scx.hpp"
+
+// Times converting scene-sized text to and from CP932, a string per call, to
+// compare opening a converter for every call as boost::locale::conv does with
+// the converters cp932 keeps open per thread.
+//  benchmark_converters [file.scx]
+// Uses the scene text of file.scx if given, otherwise some samples.
+
+namespace {
+
+const int rounds = 20;
+
+vector<string> sample_text() {
+  return {
+      u8"[\\w,2,=,2,+,-2][\\w,589,=,-1]",
+      u8"場所・みのバーカウンター",
+      u8"「いらっしゃいませ～。ご注文はお決まりですか？」",
+      u8"ＳＢ・縄掛けフェラ・顔射",
+      u8"[\\e,14,675,-1][\\w,771,=,-4]",
+      u8"全体ＭＡＰ・移動モード・昼　黎明町",
+  };
+}
+
+// Mean nanoseconds per string of calling convert on each of texts
+double time_per_call(const vector<string>& texts,
+                     const function<string(const string&)>& convert) {
+  size_t total = 0;
+  // Once untimed, to warm up the caches
+  for (const auto& text : texts) {
+    total += convert(text).size();
+  }
+  const auto start = steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    for (const auto& text : texts) {
+      total += convert(text).size();
+    }
+  }
+  const duration<double, std::nano> elapsed = steady_clock::now() - start;
+  // So the conversions are not optimised away
+  if (total == 0) {
+    cerr << "Nothing converted\n";
+  }
+  return elapsed.count() / (rounds * texts.size());
+}
+
+void report(const char* name, double decode, double encode) {
+  cout << setw(28) << std::left << name << std::right << fixed
+       << setprecision(0) << setw(10) << decode << setw(10) << encode << "\n";
+}
+
+gsl::multi_span<const char> span(const string& text) {
+  return gsl::multi_span<const char>(text);
+}
+
+#if defined(SCX_WITH_ICU)
+// Opens and closes the converters for each call
+string icu_convert_once(const char* to, const char* from, const string& text) {
+  UErrorCode error = U_ZERO_ERROR;
+  UConverter* target_converter = ucnv_open(to, &error);
+  UConverter* source_converter = ucnv_open(from, &error);
+  string result(text.size() * 3 + 16, '\0');
+  char* target = &result[0];
+  const char* source = text.data();
+  ucnv_convertEx(target_converter, source_converter, &target,
+                 result.data() + result.size(), &source,
+                 text.data() + text.size(), nullptr, nullptr, nullptr, nullptr,
+                 true, true, &error);
+  ucnv_close(source_converter);
+  ucnv_close(target_converter);
+  result.resize(U_SUCCESS(error) ? target - result.data() : 0);
+  return result;
+}
+#endif
+
+#if defined(SCX_WITH_ICONV)
+// Opens and closes the handle for each call
+string iconv_convert_once(const char* to, const char* from,
+                          const string& text) {
+  iconv_t handle = iconv_open(to, from);
+  string result(text.size() * 3 + 16, '\0');
+  char* source = const_cast<char*>(text.data());
+  size_t in_left = text.size();
+  char* target = &result[0];
+  size_t out_left = result.size();
+  iconv(handle, &source, &in_left, &target, &out_left);
+  iconv_close(handle);
+  result.resize(target - result.data());
+  return result;
+}
+#endif
+
+void time_cached(const char* name, cp932::converter which,
+                 const vector<string>& utf8, const vector<string>& encoded) {
+  if (!cp932::set_converter(which)) {
+    cout << name << ": not built\n";
+    return;
+  }
+  // Opened outside the timing, as it is only once per thread
+  cp932::to_utf8(span(encoded.front()));
+  cp932::from_utf8(span(utf8.front()));
+  report(name,
+         time_per_call(encoded,
+                       [](const string& text) {
+                         return cp932::to_utf8(span(text));
+                       }),
+         time_per_call(utf8, [](const string& text) {
+           return cp932::from_utf8(span(text));
+         }));
+  cp932::set_converter(cp932::converter::builtin);
+}
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 2) {
+    cerr << "Usage: " << argv[0] << " [file.scx]\n";
+    return 2;
+  }
+
+  vector<string> utf8;
+  if (argc == 2) {
+    SCXFile file;
+    if (!file.read(argv[1])) {
+      cerr << "Cannot read " << argv[1] << "\n";
+      return 1;
+    }
+    for (size_t i = 0; i < file.scene_count(); ++i) {
+      const auto& text = file.scene(i).text;
+      if (!text.empty()) {
+        utf8.push_back(text);
+      }
+    }
+  } else {
+    utf8 = sample_text();
+  }
+  if (utf8.empty()) {
+    cerr << "No text to convert\n";
+    return 1;
+  }
+
+  vector<string> encoded;
+  for (const auto& text : utf8) {
+    encoded.push_back(cp932::from_utf8(span(text)));
+  }
+
+  cout << utf8.size() << " strings, nanoseconds per call\n";
+  cout << setw(28) << std::left << "" << std::right << setw(10) << "decode"
+       << setw(10) << "encode"
+       << "\n";
+
+  report("builtin tables",
+         time_per_call(encoded,
+                       [](const string& text) {
+                         return cp932::to_utf8(span(text));
+                       }),
+         time_per_call(utf8, [](const string& text) {
+           return cp932::from_utf8(span(text));
+         }));
+
+  report("boost::locale::conv",
+         time_per_call(encoded,
+                       [](const string& text) {
+                         return boost::locale::conv::to_utf<char>(
+                             text, "windows-932");
+                       }),
+         time_per_call(utf8, [](const string& text) {
+           return boost::locale::conv::from_utf<char>(text, "windows-932");
+         }));
+
+#if defined(SCX_WITH_ICU)
+  report("ICU, opened per call",
+         time_per_call(encoded,
+                       [](const string& text) {
+                         return icu_convert_once("UTF-8", "windows-932", text);
+                       }),
+         time_per_call(utf8, [](const string& text) {
+           return icu_convert_once("windows-932", "UTF-8", text);
+         }));
+#endif
+  time_cached("ICU, kept per thread", cp932::converter::icu, utf8, encoded);
+
+#if defined(SCX_WITH_ICONV)
+  report("iconv, opened per call",
+         time_per_call(encoded,
+                       [](const string& text) {
+                         return iconv_convert_once("UTF-8", "WINDOWS-31J",
+                                                   text);
+                       }),
+         time_per_call(utf8, [](const string& text) {
+           return iconv_convert_once("WINDOWS-31J", "UTF-8", text);
+         }));
+#endif
+  time_cached("iconv, kept per thread", cp932::converter::iconv, utf8,
+              encoded);
+
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include <chrono>
+using std::chrono::duration;
+using std::chrono::steady_clock;
+#include <functional>
+using std::function;
+#include <iomanip>
+using std::fixed;
+using std::setprecision;
+using std::setw;
+#include <iostream>
+using std::cerr;
+using std::cout;
+#include <string>
+using std::string;
+
+#include <cstddef>
+using std::size_t;
+#include <cstdio>
+using std::remove;
+
+#include "scx.hpp"
+
+// Times reading every record of a file, and writing it out again, through
+// the record loops SCX_CHECKED_VIEWS adds bounds checks to. Build with and
+// without it to compare.
+//  benchmark_read file.scx [rounds]
+
+namespace {
+
+// Mean milliseconds per call of run, which returns false on failure
+double time_per_call(int rounds, const function<bool()>& run) {
+  // Once untimed, to warm up the caches and the page cache
+  if (!run()) {
+    return -1;
+  }
+  const auto start = steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    if (!run()) {
+      return -1;
+    }
+  }
+  const duration<double, std::milli> elapsed = steady_clock::now() - start;
+  return elapsed.count() / rounds;
+}
+
+void report(const char* name, double milliseconds) {
+  cout << setw(28) << std::left << name << std::right << fixed
+       << setprecision(2) << setw(10) << milliseconds << "\n";
+}
+
+// Touches a field of every record, so lazy reads decode them all
+size_t touch_all(const SCXFile& file) {
+  size_t total = 0;
+  for (size_t i = 0; i < file.scene_count(); ++i) {
+    total += file.scene(i).command;
+  }
+  for (size_t i = 0; i < file.table1_count(); ++i) {
+    total += file.table1(i).data.size();
+  }
+  for (size_t i = 0; i < file.variable_count(); ++i) {
+    total += file.variable(i).name.size();
+  }
+  for (size_t i = 0; i < file.bg_count(); ++i) {
+    total += file.bg(i).name.size();
+  }
+  for (size_t i = 0; i < file.chr_count(); ++i) {
+    total += file.chr(i).name.size();
+  }
+  for (size_t i = 0; i < file.se_count(); ++i) {
+    total += file.se(i).name.size();
+  }
+  for (size_t i = 0; i < file.bgm_count(); ++i) {
+    total += file.bgm(i).name.size();
+  }
+  return total;
+}
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2 || argc > 3) {
+    cerr << "Usage: " << argv[0] << " file.scx [rounds]\n";
+    return 2;
+  }
+  const string fileName = argv[1];
+  const int rounds = argc == 3 ? std::stoi(argv[2]) : 20;
+
+  SCXFile original;
+  if (!original.read(fileName)) {
+    cerr << "Cannot read " << fileName << "\n";
+    return 1;
+  }
+  const string written = fileName + ".benchmark";
+
+#if defined(SCX_CHECKED_VIEWS)
+  cout << "Record views checked, ";
+#else
+  cout << "Record views unchecked, ";
+#endif
+  cout << rounds << " rounds, milliseconds per call\n";
+
+  report("read, eager", time_per_call(rounds, [&fileName] {
+           SCXFile file;
+           return file.read(fileName);
+         }));
+  size_t touched = 0;
+  report("read lazily, touch all", time_per_call(rounds, [&fileName, &touched] {
+           SCXFile file;
+           if (!file.read(fileName, SCXFile::load_mode::lazy)) {
+             return false;
+           }
+           touched += touch_all(file);
+           return true;
+         }));
+  report("write", time_per_call(rounds, [&original, &written] {
+           return original.write(written);
+         }));
+  original.set_deduplicating(true);
+  report("write, deduplicating", time_per_call(rounds, [&original, &written] {
+           return original.write(written);
+         }));
+
+  remove(written.c_str());
+  return 0;
+}
@@ -0,0 +1,266 @@
+#include <algorithm>
+using std::sort;
+#include <array>
+using std::array;
+#include <fstream>
+using std::ifstream;
+using std::ofstream;
+#include <iomanip>
+using std::hex;
+using std::setfill;
+using std::setw;
+#include <iostream>
+using std::cerr;
+#include <map>
+using std::map;
+#include <sstream>
+using std::istringstream;
+#include <string>
+using std::getline;
+using std::stoul;
+using std::string;
+#include <vector>
+using std::vector;
+
+#include <cstddef>
+using std::size_t;
+#include <cstdint>
+using std::uint16_t;
+using std::uint8_t;
+
+// Turns mapping files in the format of Microsoft's CP932.TXT and
+// bestfit932.txt into the tables used by src/CP932.cpp.
+//  generate_cp932_tables CP932.TXT CP932BestFit.txt cp932_tables.inc
+
+namespace {
+
+using row = array<uint16_t, 0x100>;
+
+const uint8_t not_lead = 0xff;
+
+// Windows maps the user-defined area, which the mapping file leaves out, to
+// the start of the Private Use Area.
+const uint8_t user_defined_first_lead = 0xf0;
+const uint8_t user_defined_last_lead = 0xf9;
+const uint16_t user_defined_first_code_point = 0xe000;
+
+bool is_trail(unsigned byte) {
+  return (byte >= 0x40 && byte <= 0x7e) || (byte >= 0x80 && byte <= 0xfc);
+}
+
+// Where a character has more than one code, Windows encodes it as the lowest,
+// except that NEC's selection of the IBM extensions loses to the IBM
+// extensions themselves.
+bool is_nec_selected_ibm_extension(unsigned code) {
+  return code >= 0xed40 && code <= 0xeefc;
+}
+
+bool preferred(unsigned code, unsigned other) {
+  if (is_nec_selected_ibm_extension(code) !=
+      is_nec_selected_ibm_extension(other)) {
+    return !is_nec_selected_ibm_extension(code);
+  }
+  return code < other;
+}
+
+struct mapping_line {
+  unsigned first;
+  // Absent for lead bytes and undefined codes
+  bool has_second;
+  unsigned second;
+  bool lead_byte;
+};
+
+// Reads the lines which are not comments from a mapping file
+bool read_mapping(const char* fileName, vector<mapping_line>& lines) {
+  ifstream in(fileName);
+  if (!in) {
+    cerr << "Cannot read " << fileName << "\n";
+    return false;
+  }
+
+  string line;
+  while (getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    istringstream fields(line);
+    mapping_line mapping{0, false, 0, false};
+    fields >> hex >> mapping.first;
+    if (!fields) {
+      continue;
+    }
+    string second;
+    fields >> second;
+    if (second.compare(0, 2, "0x") == 0) {
+      mapping.has_second = true;
+      mapping.second = stoul(second, nullptr, 16);
+    } else {
+      mapping.lead_byte = line.find("DBCS LEAD BYTE") != string::npos;
+    }
+    lines.push_back(mapping);
+  }
+  return true;
+}
+
+void write_row(ofstream& out, const row& values, int width) {
+  out << hex << setfill('0');
+  for (size_t i = 0; i < values.size(); ++i) {
+    out << (i % 8 == 0 ? "\n    " : " ") << "0x" << setw(width) << values[i]
+        << ",";
+  }
+  out << "\n";
+}
+
+void write_table(ofstream& out, const char* declaration, const row& values,
+                 int width) {
+  out << "const std::" << declaration << "[0x100] = {";
+  write_row(out, values, width);
+  out << "};\n\n";
+}
+
+void write_table(ofstream& out, const char* declaration,
+                 const vector<row>& rows, int width) {
+  out << "const std::" << declaration << "[" << std::dec << rows.size()
+      << "][0x100] = {\n";
+  for (const auto& values : rows) {
+    out << "  {";
+    write_row(out, values, width);
+    out << "  },\n";
+  }
+  out << "};\n\n";
+}
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 4) {
+    cerr << "Usage: " << argv[0]
+         << " CP932.TXT CP932BestFit.txt output.inc\n";
+    return 2;
+  }
+
+  vector<mapping_line> mappings;
+  vector<mapping_line> best_fits;
+  if (!read_mapping(argv[1], mappings) || !read_mapping(argv[2], best_fits)) {
+    return 1;
+  }
+
+  // Decoding. 0 is unmapped everywhere except single byte 0x00, which is NULL.
+  row single_byte;
+  single_byte.fill(0);
+  row lead_row;
+  lead_row.fill(not_lead);
+  vector<row> double_byte;
+
+  for (const auto& mapping : mappings) {
+    if (mapping.lead_byte) {
+      lead_row[mapping.first] = static_cast<uint16_t>(double_byte.size());
+      double_byte.emplace_back();
+      double_byte.back().fill(0);
+    }
+  }
+
+  // code point => code
+  map<unsigned, unsigned> encoding;
+  auto add = [&encoding](unsigned code, unsigned code_point) {
+    auto found = encoding.find(code_point);
+    if (found == encoding.end() || preferred(code, found->second)) {
+      encoding[code_point] = code;
+    }
+  };
+
+  for (const auto& mapping : mappings) {
+    if (!mapping.has_second) {
+      continue;
+    }
+    const unsigned code = mapping.first;
+    if (code <= 0xff) {
+      single_byte[code] = static_cast<uint16_t>(mapping.second);
+    } else {
+      const unsigned lead = code >> 8;
+      const unsigned trail = code & 0xff;
+      if (lead > 0xff || lead_row[lead] == not_lead || !is_trail(trail)) {
+        cerr << "Bad double-byte code 0x" << hex << code << "\n";
+        return 1;
+      }
+      double_byte[lead_row[lead]][trail] =
+          static_cast<uint16_t>(mapping.second);
+    }
+    add(code, mapping.second);
+  }
+
+  uint16_t code_point = user_defined_first_code_point;
+  for (unsigned lead = user_defined_first_lead; lead <= user_defined_last_lead;
+       ++lead) {
+    for (unsigned trail = 0; trail <= 0xff; ++trail) {
+      if (is_trail(trail)) {
+        double_byte[lead_row[lead]][trail] = code_point;
+        add(lead << 8 | trail, code_point);
+        ++code_point;
+      }
+    }
+  }
+
+  // Encoding, a page of 0x100 code points at a time. Page 0 is left empty for
+  // the high bytes CP932 has nothing for.
+  row encode_page;
+  encode_page.fill(0);
+  vector<row> encode(1);
+  encode[0].fill(0);
+  for (const auto& entry : encoding) {
+    if (entry.first > 0xffff) {
+      cerr << "Code point 0x" << hex << entry.first << " is not in the BMP\n";
+      return 1;
+    }
+    auto& page = encode_page[entry.first >> 8];
+    if (page == 0) {
+      page = static_cast<uint16_t>(encode.size());
+      encode.emplace_back();
+      encode.back().fill(0);
+    }
+    encode[page][entry.first & 0xff] = static_cast<uint16_t>(entry.second);
+  }
+  if (encode.size() > 0x100) {
+    cerr << "Too many pages for encode_page\n";
+    return 1;
+  }
+
+  vector<array<uint16_t, 2>> best_fit;
+  for (const auto& mapping : best_fits) {
+    if (!mapping.has_second || encoding.count(mapping.first)) {
+      cerr << "Bad best fit for 0x" << hex << mapping.first << "\n";
+      return 1;
+    }
+    best_fit.push_back({{static_cast<uint16_t>(mapping.first),
+                         static_cast<uint16_t>(mapping.second)}});
+  }
+  sort(best_fit.begin(), best_fit.end());
+
+  ofstream out(argv[3]);
+  out << "// Generated by generate_cp932_tables. Do not edit.\n\n";
+
+  out << "// Code point for each single byte. 0 for lead bytes and unmapped\n"
+         "// bytes, except 0x00 itself.\n";
+  write_table(out, "uint16_t single_byte", single_byte, 4);
+  out << "// Row of double_byte for each lead byte, or 0xff\n";
+  write_table(out, "uint8_t lead_row", lead_row, 2);
+  out << "// Code point for each lead and trail byte, or 0 if unmapped\n";
+  write_table(out, "uint16_t double_byte", double_byte, 4);
+
+  out << "// Page of encode for each high byte of a code point\n";
+  write_table(out, "uint8_t encode_page", encode_page, 2);
+  out << "// Code for each low byte of a code point, or 0 if unmapped\n";
+  write_table(out, "uint16_t encode", encode, 4);
+
+  out << "// Code point and code, in code point order\n";
+  out << "const std::uint16_t best_fit[" << std::dec << best_fit.size()
+      << "][2] = {\n";
+  out << hex << setfill('0');
+  for (const auto& entry : best_fit) {
+    out << "    {0x" << setw(4) << entry[0] << ", 0x" << setw(4) << entry[1]
+        << "},\n";
+  }
+  out << "};\n";
+
+  return out ? 0 : 1;
+}
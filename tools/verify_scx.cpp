@@ -0,0 +1,63 @@
+#include <iomanip>
+using std::hex;
+using std::setfill;
+using std::setw;
+#include <iostream>
+using std::cerr;
+using std::cout;
+#include <string>
+using std::string;
+
+#include "scx.hpp"
+
+namespace {
+
+const char* describe(SCXFile::verify_status status) {
+  switch (status) {
+    case SCXFile::verify_status::ok:
+      return "ok";
+    case SCXFile::verify_status::unreadable:
+      return "cannot be read";
+    case SCXFile::verify_status::truncated:
+      return "too short for an SCX header";
+    case SCXFile::verify_status::bad_prefix:
+      return "not an SCX file";
+    case SCXFile::verify_status::bad_checksum:
+      return "checksum mismatch";
+    case SCXFile::verify_status::bad_section:
+      return "header describes a section outside the file";
+    case SCXFile::verify_status::bad_scene_text:
+      return "scene text offset outside the file";
+    case SCXFile::verify_status::undecodable:
+      return "text cannot be converted from CP932";
+  }
+  return "unknown";
+}
+}
+
+// Checks each SCX file named on the command line without decoding it.
+// Exits non-zero if any of them fail.
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " file.scx...\n";
+    return 2;
+  }
+
+  int failures = 0;
+  for (int i = 1; i < argc; ++i) {
+    const auto fileName = string{argv[i]};
+    const auto result = SCXFile::verify(fileName);
+    cout << fileName << ": " << describe(result.status);
+    if (result.status == SCXFile::verify_status::bad_checksum) {
+      cout << hex << setfill('0') << " (stored 0x" << setw(8)
+           << result.stored_checksum << ", computed 0x" << setw(8)
+           << result.computed_checksum << ")" << std::dec;
+    }
+    cout << "\n";
+    if (!result) {
+      ++failures;
+    }
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "scx.hpp"
+
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <gsl/gsl>
+
+// A decrypted image of one scene, one table1 string and one BG name, which
+// the tests build on. The scene text comes last, and is text as given, so it
+// can be left unterminated.
+const std::size_t scene_blob_offset = 0x48;
+const std::size_t table1_offset = scene_blob_offset + Scene::blob_size;
+const std::size_t bg_offset = table1_offset + fixed_string_size;
+const std::size_t text_offset = bg_offset + 2 * fixed_string_size;
+
+template <typename T>
+void put(std::vector<gsl::byte>& image, std::size_t offset, T value) {
+  std::memcpy(image.data() + offset, &value, sizeof(value));
+}
+
+inline void put(std::vector<gsl::byte>& image, std::size_t offset,
+                const std::string& text) {
+  std::memcpy(image.data() + offset, text.data(), text.size());
+}
+
+inline std::vector<gsl::byte> small_image(
+    const std::string& text = std::string("AB\0", 3)) {
+  std::vector<gsl::byte> image(text_offset + text.size());
+  put(image, 0, std::string("scx\0", 4));
+  SCXFileHeader header{};
+  header.scene_count = 1;
+  header.counts[SCXFileHeader::table1] = 1;
+  header.counts[SCXFileHeader::BG] = 1;
+  header.offsets[SCXFileHeader::table1] = table1_offset;
+  header.offsets[SCXFileHeader::BG] = bg_offset;
+  put(image, SCXFileHeader::offset, header);
+  put(image, SCXFileHeader::scene_string_offsets_offset,
+      static_cast<std::uint32_t>(text_offset));
+
+  // The ten uint16_t fields are 1 to 10, the second jump blob starts 0x4242,
+  // and unk3 is 77
+  for (std::uint16_t i = 0; i < 10; ++i) {
+    put(image, scene_blob_offset + i * sizeof(i),
+        static_cast<std::uint16_t>(i + 1));
+  }
+  put(image, scene_blob_offset + 20 + Scene::scene_jump_blob_size,
+      static_cast<std::uint16_t>(0x4242));
+  put(image, scene_blob_offset + 0xd4, static_cast<std::uint16_t>(77));
+
+  put(image, table1_offset, std::string("TABLE"));
+  put(image, bg_offset, std::string("bg01"));
+  // Fills its buffer, so has no null
+  put(image, bg_offset + fixed_string_size,
+      std::string(fixed_string_size, 'b'));
+  put(image, text_offset, text);
+  return image;
+}
@@ -0,0 +1,148 @@
+﻿#include "catch.hpp"
+
+#include "CP932.hpp"
+
+#include <boost/locale.hpp>
+using boost::locale::conv::from_utf;
+using boost::locale::conv::to_utf;
+using boost::locale::conv::utf_to_utf;
+
+#include <string>
+using std::string;
+
+#include <gsl/gsl>
+using gsl::multi_span;
+
+namespace {
+string decode(const string& text) {
+  return cp932::to_utf8(multi_span<const char>(text));
+}
+
+string encode(const string& text,
+              cp932::unmappable policy = cp932::unmappable::skip) {
+  return cp932::from_utf8(multi_span<const char>(text), policy);
+}
+
+// ICU's "windows-932" is IBM-943, which swaps these control codes about.
+// CP932.TXT and the Windows API leave them alone.
+bool is_rotated_control(unsigned byte) {
+  return byte == 0x1a || byte == 0x1c || byte == 0x7f;
+}
+}
+
+TEST_CASE("CP932 decodes like boost::locale for every code") {
+  for (unsigned first = 0x01; first <= 0xff; ++first) {
+    if (is_rotated_control(first)) {
+      continue;
+    }
+    string single{'A', static_cast<char>(first), 'A'};
+    INFO("single byte " << first);
+    REQUIRE(decode(single) == to_utf<char>(single, "windows-932"));
+
+    string truncated{'A', static_cast<char>(first)};
+    REQUIRE(decode(truncated) == to_utf<char>(truncated, "windows-932"));
+
+    for (unsigned second = 0x01; second <= 0xff; ++second) {
+      if (is_rotated_control(second)) {
+        continue;
+      }
+      string pair{'A', static_cast<char>(first), static_cast<char>(second),
+                  'A'};
+      INFO("pair " << first << " " << second);
+      REQUIRE(decode(pair) == to_utf<char>(pair, "windows-932"));
+    }
+  }
+}
+
+TEST_CASE("CP932 decodes the characters CP932 and Shift-JIS disagree on") {
+  REQUIRE(decode("\x81\x5c") == u8"―");
+  REQUIRE(decode("\x81\x60") == u8"～");
+  REQUIRE(decode("\x81\x61") == u8"∥");
+  REQUIRE(decode("\x81\x7c") == u8"－");
+}
+
+TEST_CASE("CP932 decodes up to the first null") {
+  const char text[] = "\x82\xa0\xb1" "ABCDEFGHIJKLMNOPQRSTUVWXYZ\0ignored";
+  REQUIRE(cp932::to_utf8(multi_span<const char>(text, sizeof(text) - 1)) ==
+          u8"あｱABCDEFGHIJKLMNOPQRSTUVWXYZ");
+  REQUIRE(decode("") == "");
+}
+
+TEST_CASE("CP932 decodes a region of strings in one pass") {
+  const string region("\x82\xa0\0\0ABC\0\xb1", 9);
+  std::vector<std::pair<std::size_t, std::size_t>> starts;
+  REQUIRE(cp932::to_utf8_strings(multi_span<const char>(region), starts) ==
+          string(u8"あ\0\0ABC\0ｱ\0", 13));
+  REQUIRE(starts == (std::vector<std::pair<std::size_t, std::size_t>>{
+                        {0, 0}, {3, 4}, {4, 5}, {8, 9}}));
+}
+
+TEST_CASE("CP932 encodes like boost::locale for every code point") {
+  for (char32_t code_point = 0x01; code_point <= 0xffff; ++code_point) {
+    // Surrogates are not characters, and ICU alone maps U+F86F
+    if (is_rotated_control(code_point) ||
+        (code_point >= 0xd800 && code_point <= 0xdfff) ||
+        code_point == 0xf86f) {
+      continue;
+    }
+    const auto text = utf_to_utf<char>(std::u32string{'A', code_point, 'A'});
+    INFO("code point " << code_point);
+    REQUIRE(encode(text) == from_utf<char>(text, "windows-932"));
+  }
+}
+
+TEST_CASE("CP932 encoding round-trips through decoding") {
+  const string text = u8"[\\w,2,=,2,+,-2]場所・みのバーカウンター～ｱⅰ∵";
+  REQUIRE(decode(encode(text)) == text);
+}
+
+TEST_CASE("CP932 platform converters agree with the builtin tables") {
+  const string text = u8"[\\w,2,=,2,+,-2]場所・みのバーカウンター～ｱ∵";
+  const string encoded = encode(text);
+  for (auto which : {cp932::converter::icu, cp932::converter::iconv}) {
+    if (!cp932::set_converter(which)) {
+      WARN("Converter " << static_cast<int>(which) << " not built");
+      continue;
+    }
+    INFO("converter " << static_cast<int>(which));
+    CHECK(decode(encoded + '\0' + "ignored") == text);
+    CHECK(encode(text) == encoded);
+    CHECK(encode(u8"1😀", cp932::unmappable::skip) == "1");
+    CHECK(encode(u8"1😀", cp932::unmappable::replace) == "1?");
+    CHECK_THROWS_AS(encode(u8"1😀", cp932::unmappable::error),
+                    const cp932::conversion_error&);
+    CHECK(encode("1\xff", cp932::unmappable::skip) == "1");
+  }
+  REQUIRE(cp932::set_converter(cp932::converter::builtin));
+  REQUIRE(cp932::current_converter() == cp932::converter::builtin);
+}
+
+TEST_CASE("CP932 encoding follows the unmappable policy") {
+  const string text = u8"¥1—é😀\xff";
+  REQUIRE(encode(text, cp932::unmappable::skip) == "1");
+  REQUIRE_THROWS_AS(encode(text, cp932::unmappable::error),
+                    const cp932::conversion_error&);
+  REQUIRE(encode(text, cp932::unmappable::replace) == "?1????");
+  REQUIRE(encode(text, cp932::unmappable::best_fit) == "\\1\x81\x5c" "e??");
+  REQUIRE(encode(string("A\0B", 3)) == string("A\0B", 3));
+}
+
+TEST_CASE("CP932 encodes into a buffer sized beforehand") {
+  const string text = u8"¥1—é場所ｱ😀\xff";
+  for (auto policy : {cp932::unmappable::skip, cp932::unmappable::replace,
+                      cp932::unmappable::best_fit}) {
+    INFO("policy " << static_cast<int>(policy));
+    const string expected = encode(text, policy);
+    const auto size = cp932::from_utf8_size(multi_span<const char>(text), policy);
+    REQUIRE(size == expected.size());
+
+    string buffer(size, '\0');
+    REQUIRE(cp932::from_utf8(multi_span<const char>(text),
+                             multi_span<char>(&buffer[0], size),
+                             policy) == size);
+    REQUIRE(buffer == expected);
+  }
+  REQUIRE_THROWS_AS(cp932::from_utf8_size(multi_span<const char>(text),
+                                          cp932::unmappable::error),
+                    const cp932::conversion_error&);
+}
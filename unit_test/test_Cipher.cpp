@@ -0,0 +1,112 @@
+#include "catch.hpp"
+
+#include "Cipher.hpp"
+
+#include <array>
+using std::array;
+#include <vector>
+using std::vector;
+
+#include <cstddef>
+using std::size_t;
+#include <cstdint>
+using std::int8_t;
+using std::uint8_t;
+using std::uint32_t;
+
+#include <gsl/gsl>
+using gsl::as_bytes;
+using gsl::as_multi_span;
+using gsl::as_writeable_bytes;
+using gsl::byte;
+
+namespace {
+// The original per-byte routine, as a reference for the kernels
+void reference_decrypt(vector<uint8_t>& data, size_t offset,
+                       uint32_t& checksum) {
+  static const array<uint8_t, 11> key{0xa9, 0xb3, 0xf2, 0x87, 0xdc, 0xaf,
+                                      0x13, 0x67, 0xd5, 0x91, 0xec};
+  checksum = 0;
+  for (size_t i = 0; i < data.size(); ++i) {
+    const size_t pos = offset + i;
+    checksum += static_cast<int8_t>(data[i]);
+    data[i] ^= static_cast<uint8_t>(key[pos % key.size()] + pos);
+  }
+}
+
+vector<uint8_t> test_pattern(size_t size) {
+  vector<uint8_t> data(size);
+  uint32_t state = 0x12345678;
+  for (auto& value : data) {
+    state = state * 1103515245 + 12345;
+    value = static_cast<uint8_t>(state >> 16);
+  }
+  return data;
+}
+}
+
+TEST_CASE("Cipher kernels match the per-byte routine") {
+  const auto initial = cipher::active_kernel();
+
+  for (auto k : {cipher::kernel::scalar, cipher::kernel::sse2,
+                 cipher::kernel::avx2}) {
+    if (!cipher::select_kernel(k)) {
+      continue;
+    }
+    // Odd sizes and offsets exercise the scalar tails and keystream wrapping.
+    for (size_t size : {0, 1, 31, 32, 63, 64, 65, 2816, 2817, 10000}) {
+      for (size_t offset : {0, 1, 33, 2815, 2816, 5000}) {
+        const auto original = test_pattern(size);
+
+        auto expected = original;
+        uint32_t expected_checksum;
+        reference_decrypt(expected, offset, expected_checksum);
+
+        auto decrypted = original;
+        auto decrypted_bytes = as_writeable_bytes(as_multi_span(decrypted));
+        REQUIRE(cipher::decrypt(decrypted_bytes, decrypted_bytes, offset) ==
+                expected_checksum);
+        REQUIRE(decrypted == expected);
+
+        REQUIRE(cipher::checksum(as_bytes(as_multi_span(original))) ==
+                expected_checksum);
+
+        // Encryption reports the checksum of what it wrote
+        vector<uint8_t> encrypted(size);
+        REQUIRE(cipher::encrypt(as_bytes(as_multi_span(decrypted)),
+                                as_writeable_bytes(as_multi_span(encrypted)),
+                                offset) == expected_checksum);
+        REQUIRE(encrypted == original);
+      }
+    }
+  }
+
+  REQUIRE(cipher::select_kernel(initial));
+}
+
+TEST_CASE("Parallel decrypt and encrypt match the serial result") {
+  // Enough for several chunks, and not a multiple of the vector step. The
+  // second size splits five ways into whole vector steps plus a short tail.
+  for (size_t size : {5 * cipher::parallel_chunk_size + 12345,
+                      5 * cipher::parallel_chunk_size + 3}) {
+    const size_t offset = 7;
+    const auto original = test_pattern(size);
+
+    auto serial = original;
+    auto serial_bytes = as_writeable_bytes(as_multi_span(serial));
+    const auto serial_checksum =
+        cipher::decrypt(serial_bytes, serial_bytes, offset, 1);
+
+    for (unsigned threads : {0u, 2u, 3u, 5u, 8u, 64u}) {
+      auto parallel = original;
+      auto parallel_bytes = as_writeable_bytes(as_multi_span(parallel));
+      REQUIRE(cipher::decrypt(parallel_bytes, parallel_bytes, offset,
+                              threads) == serial_checksum);
+      REQUIRE(parallel == serial);
+
+      REQUIRE(cipher::encrypt(parallel_bytes, parallel_bytes, offset,
+                              threads) == serial_checksum);
+      REQUIRE(parallel == original);
+    }
+  }
+}
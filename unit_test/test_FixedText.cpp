@@ -0,0 +1,111 @@
+#include "catch.hpp"
+
+#include "FixedText.hpp"
+
+#include <memory>
+using std::make_shared;
+#include <sstream>
+using std::ostringstream;
+#include <stdexcept>
+using std::length_error;
+#include <string>
+using std::string;
+
+#include <gsl/gsl>
+using gsl::multi_span;
+
+TEST_CASE("FixedText decodes a fixed string inline") {
+  const string bytes("\x82\xa0\x81\x60" "A\0ignored", 10);
+  const auto text = FixedText::from_cp932(multi_span<const char>(bytes));
+  REQUIRE(text == u8"あ～A");
+  REQUIRE(text.size() == 7);
+  REQUIRE(string(text.c_str()) == u8"あ～A");
+  REQUIRE(text.to_cp932(cp932::unmappable::error) == "\x82\xa0\x81\x60" "A");
+
+  // Half-width katakana, the worst case, in a string filling its buffer
+  const string katakana(fixed_string_size, '\xb1');
+  const auto widest = FixedText::from_cp932(multi_span<const char>(katakana));
+  REQUIRE(widest.size() == FixedText::capacity);
+  REQUIRE(widest.to_cp932(cp932::unmappable::error) == katakana);
+}
+
+TEST_CASE("FixedText keeps the bytes read until changed") {
+  // NEC's selection of an IBM extension, which encodes to the IBM one
+  const string bytes("\xed\x40", 2);
+  auto text = FixedText::from_cp932(multi_span<const char>(bytes));
+  REQUIRE(text.to_cp932(cp932::unmappable::error) == bytes);
+
+  FixedText copy = text;
+  copy = copy.str();
+  REQUIRE(copy == text);
+  REQUIRE(copy.to_cp932(cp932::unmappable::error) == "\xfa\x5c");
+}
+
+TEST_CASE("FixedText encodes into a fixed string in place") {
+  char field[fixed_string_size] = {};
+  const string bytes("\xed\x40", 2);
+  const auto kept = FixedText::from_cp932(multi_span<const char>(bytes));
+  REQUIRE(kept.to_cp932(field, cp932::unmappable::error) == 2);
+  REQUIRE(string(field, 2) == bytes);
+
+  const FixedText changed = u8"あA";
+  REQUIRE(changed.to_cp932(field, cp932::unmappable::error) == 3);
+  REQUIRE(string(field, 3) == "\x82\xa0" "A");
+}
+
+TEST_CASE("FixedText sizes its CP932 without encoding it") {
+  const string bytes("\xed\x40", 2);
+  REQUIRE(FixedText::from_cp932(multi_span<const char>(bytes))
+              .cp932_size(cp932::unmappable::error) == 2);
+
+  // Text that fits the UTF-8 buffer, but not a fixed string once encoded
+  const FixedText long_text(string(fixed_string_size + 1, 'A'));
+  REQUIRE(long_text.cp932_size(cp932::unmappable::error) ==
+          fixed_string_size + 1);
+
+  const FixedText emoji = u8"A\U0001F600";
+  REQUIRE(emoji.cp932_size(cp932::unmappable::skip) == 1);
+  REQUIRE_THROWS_AS(emoji.cp932_size(cp932::unmappable::error),
+                    const cp932::conversion_error&);
+}
+
+TEST_CASE("FixedText behaves like a std::string") {
+  FixedText text = "ABC";
+  REQUIRE(text == string("ABC"));
+  REQUIRE(text != "ABD");
+  REQUIRE_FALSE(text.empty());
+  REQUIRE(FixedText().empty());
+  REQUIRE(string(text) == "ABC");
+
+  ostringstream out;
+  out << text;
+  REQUIRE(out.str() == "ABC");
+
+  REQUIRE_THROWS_AS(FixedText(string(FixedText::capacity + 1, 'a')),
+                    const length_error&);
+}
+
+TEST_CASE("FixedText shares interned text through a pool") {
+  auto pool = make_shared<StringPool>();
+  FixedText first = u8"あ";
+  FixedText second = u8"あ";
+  FixedText other = "other";
+  const auto first_handle = first.intern(pool);
+  REQUIRE(second.intern(pool) == first_handle);
+  REQUIRE(other.intern(pool) != first_handle);
+  REQUIRE(pool->size() == 2);
+  REQUIRE(pool->find(second) == first_handle);
+  REQUIRE(pool->find(other).id() == 1);
+  REQUIRE(second.interned(*pool) == first_handle);
+  REQUIRE(pool->at(1) == other.interned(*pool));
+
+  second = "changed";
+  REQUIRE_FALSE(pool->find(second));
+  REQUIRE_FALSE(second.interned(*pool));
+
+  // The text keeps its id however it moves, and the handle stays good for as
+  // long as the pool
+  const FixedText moved = first;
+  REQUIRE(moved.interned(*pool) == first_handle);
+  REQUIRE(moved.interned(*pool).str() == u8"あ");
+}
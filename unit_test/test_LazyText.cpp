@@ -0,0 +1,151 @@
+#include "catch.hpp"
+
+#include "LazyText.hpp"
+
+#include <memory>
+using std::make_shared;
+using std::shared_ptr;
+using std::weak_ptr;
+#include <sstream>
+using std::ostringstream;
+#include <string>
+using std::string;
+
+#include <gsl/gsl>
+using gsl::multi_span;
+
+TEST_CASE("LazyText decodes on first use and releases its owner") {
+  auto owner = make_shared<string>("\x82\xa0\x81\x60" "A\0ignored", 9);
+  weak_ptr<string> watch = owner;
+  auto text = LazyText::from_cp932(multi_span<const char>(*owner), owner);
+  owner.reset();
+
+  REQUIRE_FALSE(text.decoded());
+  REQUIRE_FALSE(watch.expired());
+  REQUIRE(text.to_cp932(cp932::unmappable::error) == "\x82\xa0\x81\x60" "A");
+  REQUIRE_FALSE(text.decoded());
+
+  REQUIRE(text == u8"あ～A");
+  REQUIRE(text.decoded());
+  REQUIRE(watch.expired());
+  REQUIRE(text.to_cp932(cp932::unmappable::error) == "\x82\xa0\x81\x60" "A");
+}
+
+TEST_CASE("LazyText encodes into a buffer sized beforehand") {
+  auto owner = make_shared<string>("\x82\xa0" "A\0", 4);
+  auto text = LazyText::from_cp932(multi_span<const char>(*owner), owner);
+  owner.reset();
+
+  string buffer(text.cp932_size(cp932::unmappable::error), '\0');
+  REQUIRE(buffer.size() == 3);
+  REQUIRE(text.to_cp932(multi_span<char>(&buffer[0], buffer.size()),
+                        cp932::unmappable::error) == 3);
+  REQUIRE(buffer == "\x82\xa0" "A");
+  REQUIRE_FALSE(text.decoded());
+
+  text = text.str() + u8"～";
+  buffer.assign(text.cp932_size(cp932::unmappable::error), '\0');
+  REQUIRE(buffer.size() == 5);
+  REQUIRE(text.to_cp932(multi_span<char>(&buffer[0], buffer.size()),
+                        cp932::unmappable::error) == 5);
+  REQUIRE(buffer == "\x82\xa0" "A\x81\x60");
+}
+
+TEST_CASE("LazyText without an owner decodes straight away") {
+  const string bytes("\xb1\0", 2);
+  auto text = LazyText::from_cp932(multi_span<const char>(bytes), nullptr);
+  REQUIRE(text.decoded());
+  REQUIRE(text == u8"ｱ");
+}
+
+TEST_CASE("LazyText takes text from an arena") {
+  auto owner = make_shared<string>("\x82\xa0\0ABC\0", 7);
+  weak_ptr<string> watch = owner;
+  auto arena = make_shared<TextArena>(multi_span<const char>(*owner), owner);
+  const char* region = owner->data();
+  owner.reset();
+
+  auto first = LazyText::from_cp932(region, arena);
+  auto second = LazyText::from_cp932(region + 3, arena);
+  // Not the start of a string, so decoded by itself
+  auto tail = LazyText::from_cp932(region + 4, arena);
+  arena.reset();
+
+  REQUIRE(string(first.c_str()) == u8"あ");
+  REQUIRE(second.size() == 3);
+  REQUIRE_FALSE(first.decoded());
+  REQUIRE(first.to_cp932(cp932::unmappable::error) == "\x82\xa0");
+
+  REQUIRE(first.str() == u8"あ");
+  REQUIRE(second.str() == "ABC");
+  REQUIRE_FALSE(watch.expired());
+  REQUIRE(tail == "BC");
+  REQUIRE(watch.expired());
+}
+
+TEST_CASE("TextArena ends each string at the next null or the region") {
+  const string region("AB\0CDE", 6);
+  const TextArena arena(multi_span<const char>(region), nullptr);
+
+  REQUIRE(arena.string_at(region.data()).size() == 2);
+  REQUIRE(arena.string_at(region.data() + 1).size() == 1);
+  REQUIRE(arena.string_at(region.data() + 2).size() == 0);
+  // The last string has no null
+  const auto last = arena.string_at(region.data() + 4);
+  REQUIRE(string(last.data(), last.size()) == "DE");
+}
+
+TEST_CASE("LazyText behaves like a std::string") {
+  auto owner = make_shared<string>("ABC");
+  auto lazy = LazyText::from_cp932(multi_span<const char>(*owner), owner);
+  LazyText same = LazyText::from_cp932(multi_span<const char>(*owner), owner);
+  LazyText assigned = string("ABC");
+
+  // Catch would decode the operands to print them
+  const bool equal = lazy == same;
+  REQUIRE(equal);
+  REQUIRE_FALSE(lazy.decoded());
+  REQUIRE(lazy == assigned);
+  REQUIRE(lazy != "ABD");
+  REQUIRE(lazy.size() == 3);
+  REQUIRE_FALSE(lazy.empty());
+
+  ostringstream out;
+  out << assigned;
+  REQUIRE(out.str() == "ABC");
+
+  // Text of nothing but unmapped bytes is empty once decoded
+  auto unmapped = make_shared<string>("\x85\x40");
+  REQUIRE(LazyText::from_cp932(multi_span<const char>(*unmapped), unmapped)
+              .empty());
+  REQUIRE(LazyText().empty());
+}
+
+TEST_CASE("LazyText shares interned text through a pool") {
+  auto bytes = make_shared<string>("\x82\xa0\0\x82\xa0\0", 6);
+  auto pool = make_shared<StringPool>(bytes);
+  auto first = LazyText::from_cp932(
+      multi_span<const char>(bytes->data(), 3), bytes);
+  auto second = LazyText::from_cp932(
+      multi_span<const char>(bytes->data() + 3, 3), bytes);
+  LazyText other("other");
+  bytes.reset();
+
+  first.intern(pool);
+  second.intern(pool);
+  other.intern(pool);
+  REQUIRE(pool->size() == 2);
+  REQUIRE(first.interned() == second.interned());
+  REQUIRE(first.interned() != other.interned());
+  REQUIRE(first.interned().id() == 0);
+  REQUIRE(other.interned().id() == 1);
+  REQUIRE(&first.str() == &second.str());
+  REQUIRE(first == u8"あ");
+  REQUIRE(first.to_cp932(cp932::unmappable::error) == "\x82\xa0");
+
+  pool.reset();
+  REQUIRE(second == u8"あ");
+  second = "changed";
+  REQUIRE_FALSE(second.interned());
+  REQUIRE(second == "changed");
+}
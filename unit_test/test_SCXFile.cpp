@@ -2,20 +2,96 @@
                            // this in one cpp file
 #include "catch.hpp"
 
+#include "Cipher.hpp"
 #include "scx.hpp"
+#include "small_image.hpp"
 
+#include <algorithm>
+using std::min;
 #include <array>
 using std::array;
+#include <fstream>
+using std::ifstream;
+using std::ofstream;
+#include <ios>
+using std::ios_base;
 #include <string>
 using std::string;
+#include <vector>
+using std::vector;
 
+#include <cstddef>
+using std::size_t;
 #include <cstdint>
+using std::uint16_t;
+using std::uint32_t;
 using std::uint8_t;
+#include <cstring>
+using std::memcpy;
 
 #include <gsl/gsl>
 using gsl::as_bytes;
 using gsl::as_multi_span;
 using gsl::byte;
+using gsl::multi_span;
+
+#include <boost/container/pmr/global_resource.hpp>
+#include <boost/container/pmr/memory_resource.hpp>
+using boost::container::pmr::memory_resource;
+using boost::container::pmr::new_delete_resource;
+
+namespace {
+// Encrypts image and gives it the right checksum
+vector<byte> encrypt_image(vector<byte> image) {
+  auto encrypted = multi_span<byte>(image).subspan(SCXFileHeader::offset);
+  put(image, offsetof(SCXFileIdentifier, checksum),
+      cipher::encrypt(encrypted, encrypted, 0));
+  return image;
+}
+
+void write_image(const string& fileName, const vector<byte>& image) {
+  const auto encrypted = encrypt_image(image);
+  ofstream out(fileName, ios_base::out | ios_base::binary);
+  out.write(reinterpret_cast<const char*>(encrypted.data()), encrypted.size());
+}
+
+// Keeps the scenes and BG names it is handed
+class collecting_handler : public SCXDecoder::Handler {
+ public:
+  vector<Scene> scenes;
+  vector<AssetName> bgs;
+
+  void scene(size_t index, Scene&& scene) override {
+    REQUIRE(index == scenes.size());
+    scenes.push_back(std::move(scene));
+  }
+  void asset(SCXDecoder::section type, size_t index,
+             AssetName&& asset) override {
+    REQUIRE(type == SCXFile::bg_section);
+    REQUIRE(index == bgs.size());
+    bgs.push_back(std::move(asset));
+  }
+};
+
+// Counts what is allocated from it and not yet released
+class counting_resource : public memory_resource {
+ public:
+  size_t blocks = 0;
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    ++blocks;
+    return new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+    --blocks;
+    new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
+}
 
 TEST_CASE("Load a non-existent file") {
   SCXFile scxfile;
@@ -80,13 +156,13 @@ TEST_CASE("Load the original avking SCX file") {
   REQUIRE(scene0.unk2 == 0xffff);
   REQUIRE(scene0.chapterJump == 0xffff);
   REQUIRE(scene0.sceneJump1 == 0xffff);
-  REQUIRE(as_multi_span(scene0.sceneJumpInfo1) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene0.sceneJumpInfo(1)) == nullSceneBytes);
   REQUIRE(scene0.sceneJump2 == 0xffff);
-  REQUIRE(as_multi_span(scene0.sceneJumpInfo2) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene0.sceneJumpInfo(2)) == nullSceneBytes);
   REQUIRE(scene0.sceneJump3 == 0xffff);
-  REQUIRE(as_multi_span(scene0.sceneJumpInfo3) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene0.sceneJumpInfo(3)) == nullSceneBytes);
   REQUIRE(scene0.sceneJump4 == 25);
-  REQUIRE(as_multi_span(scene0.sceneJumpInfo4) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene0.sceneJumpInfo(4)) == nullSceneBytes);
   REQUIRE(scene0.unk3 == 0x00000000);
 
   const Scene& scene1 = scxfile.scene(1);
@@ -98,13 +174,13 @@ TEST_CASE("Load the original avking SCX file") {
   REQUIRE(scene1.unk2 == 0xffff);
   REQUIRE(scene1.chapterJump == 0xffff);
   REQUIRE(scene1.sceneJump1 == 0xffff);
-  REQUIRE(as_multi_span(scene1.sceneJumpInfo1) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene1.sceneJumpInfo(1)) == nullSceneBytes);
   REQUIRE(scene1.sceneJump2 == 0xffff);
-  REQUIRE(as_multi_span(scene1.sceneJumpInfo2) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene1.sceneJumpInfo(2)) == nullSceneBytes);
   REQUIRE(scene1.sceneJump3 == 16);
-  REQUIRE(as_multi_span(scene1.sceneJumpInfo3) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene1.sceneJumpInfo(3)) == nullSceneBytes);
   REQUIRE(scene1.sceneJump4 == 0xffff);
-  REQUIRE(as_multi_span(scene1.sceneJumpInfo4) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene1.sceneJumpInfo(4)) == nullSceneBytes);
   REQUIRE(scene1.unk3 == 0x00000000);
 
   const Scene& scene14500 = scxfile.scene(14500);
@@ -148,13 +224,13 @@ TEST_CASE("Load the original avking SCX file") {
   REQUIRE(scene14500.unk2 == 0xffff);
   REQUIRE(scene14500.chapterJump == 0xffff);
   REQUIRE(scene14500.sceneJump1 == 0xffff);
-  REQUIRE(as_multi_span(scene14500.sceneJumpInfo1) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene14500.sceneJumpInfo(1)) == nullSceneBytes);
   REQUIRE(scene14500.sceneJump2 == 0xffff);
-  REQUIRE(as_multi_span(scene14500.sceneJumpInfo2) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene14500.sceneJumpInfo(2)) == nullSceneBytes);
   REQUIRE(scene14500.sceneJump3 == 2);
-  REQUIRE(as_multi_span(scene14500.sceneJumpInfo3) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene14500.sceneJumpInfo(3)) == nullSceneBytes);
   REQUIRE(scene14500.sceneJump4 == 0xffff);
-  REQUIRE(as_multi_span(scene14500.sceneJumpInfo4) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene14500.sceneJumpInfo(4)) == nullSceneBytes);
   REQUIRE(scene14500.unk3 == 0x00000000);
 
   const Scene& scene16912 = scxfile.scene(16912);
@@ -166,13 +242,13 @@ TEST_CASE("Load the original avking SCX file") {
   REQUIRE(scene16912.unk2 == 0xffff);
   REQUIRE(scene16912.chapterJump == 0xffff);
   REQUIRE(scene16912.sceneJump1 == 0xffff);
-  REQUIRE(as_multi_span(scene16912.sceneJumpInfo1) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene16912.sceneJumpInfo(1)) == nullSceneBytes);
   REQUIRE(scene16912.sceneJump2 == 32);
-  REQUIRE(as_multi_span(scene16912.sceneJumpInfo2) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene16912.sceneJumpInfo(2)) == nullSceneBytes);
   REQUIRE(scene16912.sceneJump3 == 0xffff);
-  REQUIRE(as_multi_span(scene16912.sceneJumpInfo3) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene16912.sceneJumpInfo(3)) == nullSceneBytes);
   REQUIRE(scene16912.sceneJump4 == 0xffff);
-  REQUIRE(as_multi_span(scene16912.sceneJumpInfo4) == nullSceneBytes);
+  REQUIRE(as_multi_span(scene16912.sceneJumpInfo(4)) == nullSceneBytes);
   REQUIRE(scene16912.unk3 == 0x00000000);
 
   const Table1Data& table1_0 = scxfile.table1(0);
@@ -239,8 +315,578 @@ TEST_CASE("Load the original avking SCX file") {
   REQUIRE(var780.comment == u8"");
 }
 
+TEST_CASE("Load the original avking SCX file lazily") {
+  SCXFile scxfile;
+  REQUIRE(scxfile.read("../../avking.scx", SCXFile::load_mode::lazy) == true);
+
+  REQUIRE(scxfile.scene_count() == 16913);
+  REQUIRE(scxfile.table1_count() == 474);
+  REQUIRE(scxfile.variable_count() == 781);
+  REQUIRE(scxfile.bg_count() == 553);
+  REQUIRE(scxfile.chr_count() == 985);
+  REQUIRE(scxfile.se_count() == 191);
+  REQUIRE(scxfile.bgm_count() == 33);
+  REQUIRE(scxfile.voice_count() == 24454);
+
+  // Sections are decoded in any order, and only once accessed
+  const Variable& var283 = scxfile.variable(283);
+  REQUIRE(var283.name == u8"ＴＣ・卑語・レッスン回数");
+  REQUIRE(var283.comment == u8"場所・みのバーカウンター");
+
+  const AssetName& bg1 = scxfile.bg(1);
+  REQUIRE(bg1.name == u8"全体ＭＡＰ・移動モード・昼");
+  REQUIRE(bg1.abbreviation == u8"黎明町");
+
+  REQUIRE(scxfile.verify_checksum() == true);
+
+  const Scene& scene1 = scxfile.scene(1);
+  REQUIRE(scene1.text == u8"[\\w,2,=,2,+,-2][\\w,589,=,-1]");
+  REQUIRE(scene1.sceneJump3 == 16);
+
+  const Table1Data& table1_473 = scxfile.table1(473);
+  REQUIRE(table1_473.data == u8"ＳＢ・縄掛けフェラ・顔射");
+
+  REQUIRE(scxfile.scene_count() == 16913);
+  REQUIRE(scxfile.verify_checksum() == true);
+}
+
+// The UTF-8 of text in a view
+static string utf8(gsl::cstring_span<> cp932text) {
+  return cp932::to_utf8(
+      multi_span<const char>(cp932text.data(), cp932text.size()));
+}
+
+TEST_CASE("View the original avking SCX file in place") {
+  SCXView view;
+  REQUIRE(view.read("../../avking.scx") == true);
+
+  REQUIRE(view.scene_count() == 16913);
+  REQUIRE(view.table1_count() == 474);
+  REQUIRE(view.variable_count() == 781);
+  REQUIRE(view.bg_count() == 553);
+  REQUIRE(view.voice_count() == 24454);
+
+  REQUIRE(view.scene(1).sceneJump3() == 16);
+  REQUIRE(utf8(view.variable(283).name()) == u8"ＴＣ・卑語・レッスン回数");
+  REQUIRE(utf8(view.bg(1).abbreviation()) == u8"黎明町");
+
+  SCXFile scxfile;
+  REQUIRE(scxfile.read(view) == true);
+  REQUIRE(scxfile.scene_count() == 16913);
+  REQUIRE(scxfile.scene(1).text == u8"[\\w,2,=,2,+,-2][\\w,589,=,-1]");
+  REQUIRE(scxfile.table1(473).data == u8"ＳＢ・縄掛けフェラ・顔射");
+}
+
+TEST_CASE("Stream the original avking SCX file") {
+  SCXFile scxfile;
+  ifstream in("../../avking.scx", ios_base::in | ios_base::binary);
+  REQUIRE(scxfile.read(in) == true);
+
+  REQUIRE(scxfile.scene_count() == 16913);
+  REQUIRE(scxfile.table1_count() == 474);
+  REQUIRE(scxfile.variable_count() == 781);
+  REQUIRE(scxfile.bg_count() == 553);
+  REQUIRE(scxfile.chr_count() == 985);
+  REQUIRE(scxfile.se_count() == 191);
+  REQUIRE(scxfile.bgm_count() == 33);
+  REQUIRE(scxfile.voice_count() == 24454);
+
+  REQUIRE(scxfile.scene(16912).text == u8"[\\e,14,675,-1][\\w,771,=,-4]");
+  REQUIRE(scxfile.table1(45).data == u8"メイン・撮影処理・撮影後判定");
+  REQUIRE(scxfile.variable(283).comment == u8"場所・みのバーカウンター");
+  REQUIRE(scxfile.bg(552).name == u8"ＳＢ・輪姦・騎乗位Ｂ・日本");
+}
+
+TEST_CASE("Intern the text of the original avking SCX file") {
+  SCXFile scxfile;
+  scxfile.set_interning(true);
+  REQUIRE(scxfile.read("../../avking.scx", SCXFile::load_mode::lazy) == true);
+
+  const StringPool& pool = *scxfile.string_pool();
+  const Variable& var283 = scxfile.variable(283);
+  REQUIRE(var283.comment == u8"場所・みのバーカウンター");
+  REQUIRE(var283.comment.interned(pool));
+
+  // Every empty comment is the same string in the pool
+  const Variable& var0 = scxfile.variable(0);
+  const Variable& var1 = scxfile.variable(1);
+  REQUIRE(var0.comment.interned(pool) == var1.comment.interned(pool));
+  REQUIRE(var0.comment.interned(pool) != var283.comment.interned(pool));
+  REQUIRE(scxfile.string_pool()->size() < 2 * scxfile.variable_count());
+
+  REQUIRE(scxfile.scene(1).text == u8"[\\w,2,=,2,+,-2][\\w,589,=,-1]");
+  REQUIRE(scxfile.write("avking.scx.interned") == true);
+  REQUIRE(SCXFile::verify("avking.scx.interned").status ==
+          SCXFile::verify_status::ok);
+}
+
+TEST_CASE("Scan the scenes of the original avking SCX file as columns") {
+  SCXFile scxfile;
+  REQUIRE(scxfile.read("../../avking.scx", SCXFile::load_mode::lazy) == true);
+  const SceneTable table = scxfile.scene_table();
+  REQUIRE(table.size() == 16913);
+  REQUIRE(table.text[1] == u8"[\\w,2,=,2,+,-2][\\w,589,=,-1]");
+  REQUIRE(table.sceneJump3[1] == 16);
+
+  const auto chapter = scxfile.scene(16912).chapter;
+  const auto command = scxfile.scene(16912).command;
+  const auto found = table.select(chapter, command);
+  REQUIRE(!found.empty());
+  REQUIRE(found.back() == 16912);
+  for (auto i : found) {
+    REQUIRE(scxfile.scene(i).chapter == chapter);
+    REQUIRE(scxfile.scene(i).command == command);
+  }
+}
+
+TEST_CASE("Allocate the records from the caller's memory resource") {
+  write_image("small.scx", small_image());
+  counting_resource resource;
+  {
+    SCXFile scxfile(&resource);
+    REQUIRE(scxfile.read("small.scx"));
+    const size_t blocks = resource.blocks;
+    REQUIRE(blocks > 0);
+    REQUIRE(scxfile.scene(0).text == "AB");
+    REQUIRE(scxfile.bg(0).name == "bg01");
+
+    // A failed read releases what it allocated, and leaves the file as it was
+    REQUIRE(!scxfile.read("bananas.scx"));
+    REQUIRE(resource.blocks == blocks);
+    REQUIRE(scxfile.scene_count() == 1);
+
+    // Reading again releases the records of the last read
+    REQUIRE(scxfile.read("small.scx"));
+    REQUIRE(resource.blocks == blocks);
+  }
+  REQUIRE(resource.blocks == 0);
+}
+
+TEST_CASE("Copy scenes out of a file and release its memory resource") {
+  write_image("small.scx", small_image());
+  counting_resource resource;
+  Scene scene;
+  {
+    SCXFile scxfile(&resource);
+    REQUIRE(scxfile.read("small.scx"));
+    scene = scxfile.scene(0);
+  }
+  // The copy's jump blobs are still there
+  REQUIRE(resource.blocks == 0);
+  REQUIRE(scene.has_sceneJumpInfo(2));
+  REQUIRE(scene.sceneJumpInfo(2)[0] == static_cast<byte>(0x42));
+  REQUIRE(scene.text == "AB");
+}
+
+TEST_CASE("Intern the fixed strings of a file") {
+  write_image("small.scx", small_image());
+  SCXFile scxfile;
+  scxfile.set_interning(true);
+  REQUIRE(scxfile.read("small.scx"));
+
+  const StringPool& pool = *scxfile.string_pool();
+  const auto name = scxfile.bg(0).name.interned(pool);
+  REQUIRE(name);
+  REQUIRE(name.str() == "bg01");
+  REQUIRE(name != scxfile.bg(0).abbreviation.interned(pool));
+  REQUIRE(scxfile.table1(0).data.interned(pool).str() == "TABLE");
+
+  // Copies keep the id, which is dropped once the text is set
+  AssetName copy = scxfile.bg(0);
+  REQUIRE(copy.name.interned(pool) == name);
+  copy.name = "bg02";
+  REQUIRE_FALSE(copy.name.interned(pool));
+}
+
+TEST_CASE("Parse a file and say why it cannot be read") {
+  SCXFile scxfile;
+  write_image("small.scx", small_image());
+  REQUIRE(scxfile.parse("small.scx"));
+  REQUIRE(scxfile.scene(0).text == "AB");
+  REQUIRE(scxfile.bg(0).name == "bg01");
+
+  auto failure = [&scxfile](vector<byte> image) {
+    write_image("small.scx", image);
+    const auto result = scxfile.parse("small.scx");
+    REQUIRE(!result);
+    return result;
+  };
+
+  auto image = small_image();
+  put(image, SCXFileHeader::offset_field(SCXFileHeader::BG),
+      static_cast<uint32_t>(image.size() + 1));
+  auto result = failure(image);
+  REQUIRE(result.status == SCXFile::verify_status::bad_section);
+  REQUIRE(result.failed_section == SCXFile::bg_section);
+  REQUIRE(result.offset == SCXFileHeader::offset_field(SCXFileHeader::BG));
+
+  image = small_image();
+  put(image, SCXFileHeader::count_field(SCXFileHeader::BG), uint32_t{2});
+  result = failure(image);
+  REQUIRE(result.status == SCXFile::verify_status::bad_section);
+  REQUIRE(result.failed_section == SCXFile::bg_section);
+  REQUIRE(result.offset == SCXFileHeader::count_field(SCXFileHeader::BG));
+
+  // Voice file names are not stored, so have no offset
+  image = small_image();
+  put(image, SCXFileHeader::offset_field(SCXFileHeader::VOICE), uint32_t{4});
+  result = failure(image);
+  REQUIRE(result.status == SCXFile::verify_status::bad_section);
+  REQUIRE(result.failed_section == SCXFile::voice_section);
+  REQUIRE(result.offset == SCXFileHeader::offset_field(SCXFileHeader::VOICE));
+  REQUIRE(!SCXFile::verify("small.scx"));
+  {
+    ifstream in("small.scx", ios_base::in | ios_base::binary);
+    REQUIRE(!scxfile.read(in));
+  }
+
+  image = small_image();
+  put(image, SCXFileHeader::scene_count_field, uint32_t{0xffffffff});
+  result = failure(image);
+  REQUIRE(result.status == SCXFile::verify_status::bad_section);
+  REQUIRE(result.failed_section == SCXFile::scene_section);
+  REQUIRE(result.offset == SCXFileHeader::scene_count_field);
+
+  image = small_image();
+  put(image, SCXFileHeader::scene_string_offsets_offset,
+      static_cast<uint32_t>(image.size()));
+  result = failure(image);
+  REQUIRE(result.status == SCXFile::verify_status::bad_scene_text);
+  REQUIRE(result.failed_section == SCXFile::scene_section);
+  REQUIRE(result.offset == SCXFileHeader::scene_string_offsets_offset);
+
+  image = small_image();
+  image[0] = static_cast<byte>('S');
+  result = failure(image);
+  REQUIRE(result.status == SCXFile::verify_status::bad_prefix);
+  REQUIRE(result.failed_section == SCXFile::section_count);
+
+  image = small_image();
+  image.resize(SCXFileHeader::offset + SCXFileHeader::size - 1);
+  result = failure(image);
+  REQUIRE(result.status == SCXFile::verify_status::truncated);
+  REQUIRE(result.offset == image.size());
+
+  // Corrupted after the checksum was worked out
+  write_image("small.scx", small_image());
+  {
+    ofstream out("small.scx",
+                 ios_base::in | ios_base::out | ios_base::binary);
+    out.seekp(text_offset);
+    out.put('X');
+  }
+  result = scxfile.parse("small.scx");
+  REQUIRE(result.status == SCXFile::verify_status::bad_checksum);
+  REQUIRE(result.offset == offsetof(SCXFileIdentifier, checksum));
+  REQUIRE(scxfile.parse("small.scx", SCXFile::load_mode::lazy));
+
+  const string text = scxfile.scene(0).text.str();
+  result = scxfile.parse("bananas.scx");
+  REQUIRE(result.status == SCXFile::verify_status::unreadable);
+  REQUIRE(result.failed_section == SCXFile::section_count);
+  // A directory opens, but cannot be mapped
+  result = scxfile.parse(".");
+  REQUIRE(result.status == SCXFile::verify_status::unreadable);
+  REQUIRE(scxfile.scene(0).text == text);
+
+  // However many voices there are, they take no room in the file or memory
+  image = small_image();
+  put(image, SCXFileHeader::count_field(SCXFileHeader::VOICE),
+      uint32_t{0xffffffff});
+  write_image("small.scx", image);
+  REQUIRE(SCXFile::verify("small.scx"));
+  REQUIRE(scxfile.parse("small.scx"));
+  REQUIRE(scxfile.voice_count() == 0xffffffff);
+  REQUIRE(scxfile.voice(0xfffffffe).name.empty());
+  {
+    ifstream in("small.scx", ios_base::in | ios_base::binary);
+    REQUIRE(scxfile.read(in));
+    REQUIRE(scxfile.voice_count() == 0xffffffff);
+  }
+}
+
+TEST_CASE("Read scene text which runs to the end of the file") {
+  SCXFile scxfile;
+  auto image = small_image();
+  // Text with no null
+  image.back() = static_cast<byte>('C');
+  write_image("small.scx", image);
+  REQUIRE(scxfile.read("small.scx"));
+  REQUIRE(scxfile.scene(0).text == "ABC");
+  {
+    ifstream in("small.scx", ios_base::in | ios_base::binary);
+    REQUIRE(scxfile.read(in));
+    REQUIRE(scxfile.scene(0).text == "ABC");
+  }
+
+  // Text from the middle of another
+  put(image, SCXFileHeader::scene_string_offsets_offset,
+      static_cast<uint32_t>(text_offset + 1));
+  write_image("small.scx", image);
+  REQUIRE(scxfile.read("small.scx", SCXFile::load_mode::lazy));
+  REQUIRE(scxfile.scene(0).text == "BC");
+}
+
+TEST_CASE("Decode a file fed in small chunks") {
+  // The second has no null, so its text runs to the end of the file
+  for (const string text : {"AB", "ABC"}) {
+    auto image = small_image();
+    if (text == "ABC") {
+      image.back() = static_cast<byte>('C');
+    }
+    const auto encrypted = encrypt_image(image);
+    // Records and text split across chunks at every point
+    for (size_t chunk_size : {size_t{1}, size_t{7}}) {
+      collecting_handler handler;
+      SCXDecoder decoder(handler);
+      for (size_t i = 0; i < encrypted.size(); i += chunk_size) {
+        REQUIRE(decoder.feed(multi_span<const byte>(encrypted).subspan(
+            i, min(chunk_size, encrypted.size() - i))));
+      }
+      REQUIRE(decoder.finish());
+      REQUIRE(handler.scenes.size() == 1);
+      REQUIRE(handler.scenes[0].text == text);
+      REQUIRE(handler.bgs.size() == 1);
+      REQUIRE(handler.bgs[0].name == "bg01");
+    }
+  }
+}
+
+TEST_CASE("Write a file back to where it was read from") {
+  write_image("small.scx", small_image());
+  for (const auto mode :
+       {SCXFile::load_mode::eager, SCXFile::load_mode::lazy}) {
+    SCXFile scxfile;
+    REQUIRE(scxfile.read("small.scx", mode));
+    REQUIRE(scxfile.write("small.scx"));
+    REQUIRE(scxfile.scene(0).text == "AB");
+
+    REQUIRE(scxfile.read("small.scx"));
+    REQUIRE(scxfile.scene(0).text == "AB");
+    REQUIRE(scxfile.bg(0).name == "bg01");
+  }
+}
+
+TEST_CASE("Scenes with the same text offset share their text") {
+  // Four scenes, two at "ABC" and two at the "BC" within it
+  const size_t blobs_offset = SCXFileHeader::scene_string_offsets_offset +
+                              4 * sizeof(uint32_t);
+  const size_t shared_offset = blobs_offset + 4 * Scene::blob_size;
+  vector<byte> image(shared_offset + 4);
+  memcpy(image.data(), "scx\0", 4);
+  SCXFileHeader header{};
+  header.scene_count = 4;
+  put(image, SCXFileHeader::offset, header);
+  const array<uint32_t, 4> offsets = {
+      {static_cast<uint32_t>(shared_offset),
+       static_cast<uint32_t>(shared_offset),
+       static_cast<uint32_t>(shared_offset + 1),
+       static_cast<uint32_t>(shared_offset + 1)}};
+  put(image, SCXFileHeader::scene_string_offsets_offset, offsets);
+  memcpy(image.data() + shared_offset, "ABC", 4);
+  write_image("small.scx", image);
+
+  SCXFile scxfile;
+  REQUIRE(scxfile.read("small.scx"));
+  REQUIRE(scxfile.scene(0).text == "ABC");
+  REQUIRE(scxfile.scene(1).text == "ABC");
+  REQUIRE(scxfile.scene(2).text == "BC");
+  REQUIRE(scxfile.scene(3).text == "BC");
+  REQUIRE(scxfile.scene(0).text.source() == scxfile.scene(1).text.source());
+  REQUIRE(scxfile.scene(2).text.source() == scxfile.scene(3).text.source());
+
+  // Each text is written once. The text is still read from small.scx, so is
+  // written elsewhere.
+  REQUIRE(scxfile.write("shared.scx"));
+  REQUIRE(ifstream("shared.scx", ios_base::binary | ios_base::ate).tellg() ==
+          static_cast<std::streamoff>(shared_offset + 4 + 3));
+  REQUIRE(scxfile.read("shared.scx", SCXFile::load_mode::lazy));
+  REQUIRE(scxfile.scene(1).text == "ABC");
+  REQUIRE(scxfile.scene(3).text == "BC");
+
+  // Unless one has been decoded into a copy of its own
+  scxfile.scene(1).text.str();
+  REQUIRE(scxfile.scene(1).text.source().first == nullptr);
+  REQUIRE(scxfile.write("small.scx"));
+  REQUIRE(ifstream("small.scx", ios_base::binary | ios_base::ate).tellg() ==
+          static_cast<std::streamoff>(shared_offset + 4 + 3 + 4));
+}
+
+TEST_CASE("Write each distinct scene text once when deduplicating") {
+  // Four scenes, the first and third with the same text, the last with none
+  const size_t blobs_offset = SCXFileHeader::scene_string_offsets_offset +
+                              4 * sizeof(uint32_t);
+  const size_t text_offset = blobs_offset + 4 * Scene::blob_size;
+  vector<byte> image(text_offset + 9);
+  memcpy(image.data(), "scx\0", 4);
+  SCXFileHeader header{};
+  header.scene_count = 4;
+  put(image, SCXFileHeader::offset, header);
+  const array<uint32_t, 4> offsets = {{static_cast<uint32_t>(text_offset),
+                                       static_cast<uint32_t>(text_offset + 3),
+                                       static_cast<uint32_t>(text_offset + 6),
+                                       0}};
+  put(image, SCXFileHeader::scene_string_offsets_offset, offsets);
+  memcpy(image.data() + text_offset, "AB\0XY\0AB", 9);
+  write_image("small.scx", image);
+
+  SCXFile scxfile;
+  REQUIRE_FALSE(scxfile.deduplicating());
+  REQUIRE(scxfile.read("small.scx"));
+  auto written_size = [](const string& fileName) {
+    return static_cast<size_t>(
+        ifstream(fileName, ios_base::binary | ios_base::ate).tellg());
+  };
+
+  REQUIRE(scxfile.write("shared.scx"));
+  REQUIRE(written_size("shared.scx") == image.size());
+
+  // Found to be the same as the first whether or not it has been decoded
+  scxfile.scene(2).text.str();
+  scxfile.set_deduplicating(true);
+  REQUIRE(scxfile.write("shared.scx"));
+  REQUIRE(written_size("shared.scx") == text_offset + 6);
+
+  SCXFile written;
+  REQUIRE(written.read("shared.scx"));
+  REQUIRE(written.scene_count() == 4);
+  REQUIRE(written.scene(0).text == "AB");
+  REQUIRE(written.scene(1).text == "XY");
+  REQUIRE(written.scene(2).text == "AB");
+  REQUIRE(written.scene(3).text == "");
+  // Read with one offset, so still shared
+  REQUIRE(written.scene(0).text.source() == written.scene(2).text.source());
+}
+
+TEST_CASE("Verify a non-existent file") {
+  const auto result = SCXFile::verify("bananas.scx");
+  REQUIRE(!result);
+  REQUIRE(result.status == SCXFile::verify_status::unreadable);
+}
+
+TEST_CASE("Verify the original avking SCX file") {
+  const auto result = SCXFile::verify("../../avking.scx");
+  REQUIRE(result.status == SCXFile::verify_status::ok);
+  REQUIRE(result.stored_checksum == result.computed_checksum);
+}
+
+TEST_CASE("Patch a scene and keep the blob bytes it does not hold") {
+  auto image = small_image();
+  for (size_t i = 0; i < Scene::blob_size; ++i) {
+    image[scene_blob_offset + i] = static_cast<byte>(i + 1);
+  }
+  write_image("small.scx", image);
+
+  SCXFile original;
+  REQUIRE(original.read("small.scx"));
+  Scene scene = original.scene(0);
+  scene.sceneJump3 = 17;
+
+  SCXPatcher patcher;
+  REQUIRE(patcher.open("small.scx"));
+  REQUIRE(patcher.set_scene(0, scene));
+  REQUIRE(patcher.flush());
+
+  vector<byte> patched(image.size());
+  {
+    ifstream in("small.scx", ios_base::in | ios_base::binary);
+    in.read(reinterpret_cast<char*>(patched.data()), patched.size());
+    REQUIRE(in.gcount() == static_cast<std::streamsize>(patched.size()));
+  }
+  auto encrypted = multi_span<byte>(patched).subspan(SCXFileHeader::offset);
+  cipher::decrypt(encrypted, encrypted, 0);
+
+  // Only sceneJump3, the ninth uint16_t of the blob, and the checksum differ
+  put(image, scene_blob_offset + 8 * sizeof(uint16_t), uint16_t{17});
+  const size_t checksum_offset = offsetof(SCXFileIdentifier, checksum);
+  memcpy(image.data() + checksum_offset, patched.data() + checksum_offset,
+         sizeof(uint32_t));
+  REQUIRE(patched == image);
+  REQUIRE(SCXFile::verify("small.scx"));
+}
+
+TEST_CASE("Patch a BG name too long for its fixed string") {
+  const auto image = small_image();
+  write_image("small.scx", image);
+
+  SCXFile original;
+  REQUIRE(original.read("small.scx"));
+  AssetName bg = original.bg(0);
+  // Fits FixedText, but not a fixed string
+  bg.name = string(40, 'A');
+
+  SCXPatcher patcher;
+  REQUIRE(patcher.open("small.scx"));
+  REQUIRE(patcher.set_bg(0, bg) == false);
+  bg.name = u8"bg\U0001F600";
+  patcher.set_unmappable(cp932::unmappable::error);
+  REQUIRE(patcher.set_bg(0, bg) == false);
+  REQUIRE(patcher.flush());
+
+  SCXFile patched;
+  REQUIRE(patched.read("small.scx"));
+  REQUIRE(patched.bg(0).name == "bg01");
+  REQUIRE(SCXFile::verify("small.scx"));
+}
+
+TEST_CASE("Patch records of the original avking SCX file in place") {
+  {
+    ifstream in("../../avking.scx", ios_base::in | ios_base::binary);
+    ofstream out("avking.scx.patched", ios_base::out | ios_base::binary);
+    REQUIRE(in.is_open());
+    out << in.rdbuf();
+  }
+
+  SCXFile original;
+  REQUIRE(original.read("../../avking.scx") == true);
+
+  Variable variable = original.variable(283);
+  variable.comment = u8"場所・みのバーカウンター２";
+  Scene scene = original.scene(1);
+  scene.sceneJump3 = 17;
+  AssetName bg = original.bg(552);
+  bg.abbreviation = u8"日本";
+
+  SCXPatcher patcher;
+  REQUIRE(patcher.open("avking.scx.patched") == true);
+  REQUIRE(patcher.variable_count() == 781);
+  REQUIRE(patcher.set_variable(283, variable) == true);
+  REQUIRE(patcher.set_scene(1, scene) == true);
+  REQUIRE(patcher.set_bg(552, bg) == true);
+  REQUIRE(patcher.set_bg(553, bg) == false);
+  REQUIRE(patcher.flush() == true);
+
+  REQUIRE(SCXFile::verify("avking.scx.patched").status ==
+          SCXFile::verify_status::ok);
+
+  SCXFile patched;
+  REQUIRE(patched.read("avking.scx.patched") == true);
+  REQUIRE(patched.variable(283).comment == variable.comment);
+  REQUIRE(patched.variable(283).name == variable.name);
+  REQUIRE(patched.scene(1).sceneJump3 == 17);
+  REQUIRE(patched.scene(1).text == scene.text);
+  REQUIRE(patched.bg(552).abbreviation == u8"日本");
+  REQUIRE(patched.bg(551).name == original.bg(551).name);
+}
+
 TEST_CASE("Load the original avking SCX file and write it out again") {
   SCXFile scxfile;
   REQUIRE(scxfile.read("../../avking.scx") == true);
   REQUIRE(scxfile.write("avking.scx.out") == true);
 }
+
+TEST_CASE("Write the original avking SCX file with its scene text shared") {
+  SCXFile scxfile;
+  REQUIRE(scxfile.read("../../avking.scx") == true);
+  scxfile.set_deduplicating(true);
+  REQUIRE(scxfile.write("avking.scx.shared") == true);
+
+  SCXFile written;
+  REQUIRE(written.read("avking.scx.shared") == true);
+  REQUIRE(written.scene_count() == scxfile.scene_count());
+  for (size_t i = 0; i < scxfile.scene_count(); ++i) {
+    REQUIRE(written.scene(i).text == scxfile.scene(i).text);
+    REQUIRE(written.scene(i).command == scxfile.scene(i).command);
+  }
+  REQUIRE(written.bg_count() == scxfile.bg_count());
+}
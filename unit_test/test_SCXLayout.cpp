@@ -0,0 +1,54 @@
+#include "catch.hpp"
+
+#include "SCXLayout.hpp"
+
+#include <vector>
+using std::vector;
+
+#include <cstddef>
+using std::size_t;
+#include <cstdint>
+using std::uint32_t;
+
+#include <gsl/gsl>
+using gsl::byte;
+using gsl::multi_span;
+
+TEST_CASE("SCXLayout hands out views of the sections it has checked") {
+  // Two scenes, one variable, one table1 string and one BG pair
+  SCXFileHeader header{};
+  header.scene_count = 2;
+  header.counts[SCXFileHeader::variable] = 1;
+  header.counts[SCXFileHeader::table1] = 1;
+  header.counts[SCXFileHeader::BG] = 1;
+  const size_t strings = static_cast<size_t>(header.blobs_end());
+  header.offsets[SCXFileHeader::table1] = strings;
+  header.offsets[SCXFileHeader::variable] = strings + fixed_string_size;
+  header.offsets[SCXFileHeader::BG] = strings + 3 * fixed_string_size;
+  const size_t file_size = strings + 5 * fixed_string_size;
+
+  SCXLayout layout;
+  REQUIRE_FALSE(layout.locate(header, file_size - 1));
+  REQUIRE(layout.file_size() == 0);
+  REQUIRE(layout.locate(header, file_size));
+  REQUIRE(layout.scene_blobs_offset() == 0x4c);
+  REQUIRE(layout.variable_blobs_offset() == 0x4c + 2 * Scene::blob_size);
+  REQUIRE(layout.strings_size(SCXFileHeader::BG) == 2 * fixed_string_size);
+
+  vector<byte> image(file_size);
+  multi_span<byte> bytes(image);
+  layout.scene_text_offsets(bytes)[1] = 0x1234;
+  REQUIRE(image[0x48] == static_cast<byte>(0x34));
+  layout.scene_blobs(bytes)[1][0] = static_cast<byte>(1);
+  REQUIRE(image[0x4c + Scene::blob_size] == static_cast<byte>(1));
+  layout.variable_blobs(bytes)[0][0] = static_cast<byte>(2);
+  REQUIRE(image[layout.variable_blobs_offset()] == static_cast<byte>(2));
+
+  const auto bg = layout.strings(multi_span<const byte>(image),
+                                 SCXFileHeader::BG);
+  REQUIRE(bg.size() == 2);
+  layout.strings(bytes, SCXFileHeader::BG)[1][0] = static_cast<byte>(3);
+  REQUIRE(bg[1][0] == static_cast<byte>(3));
+  REQUIRE(image[strings + 4 * fixed_string_size] == static_cast<byte>(3));
+  REQUIRE(layout.strings(bytes, SCXFileHeader::CHR).size() == 0);
+}
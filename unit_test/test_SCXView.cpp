@@ -0,0 +1,79 @@
+#include "catch.hpp"
+
+#include "scx.hpp"
+#include "small_image.hpp"
+
+#include <string>
+using std::string;
+
+#include <cstdint>
+using std::uint32_t;
+
+#include <gsl/gsl>
+using gsl::byte;
+using gsl::multi_span;
+
+TEST_CASE("SCXView reads records in place") {
+  const auto image = small_image(string("\x82\xa0" "A\0", 4));
+  SCXView view;
+  REQUIRE(view.view(multi_span<const byte>(image)));
+  REQUIRE(view.owner() == nullptr);
+
+  REQUIRE(view.scene_count() == 1);
+  const auto scene = view.scene(0);
+  REQUIRE(scene.chapter() == 1);
+  REQUIRE(scene.sceneJump4() == 10);
+  REQUIRE(scene.sceneJumpInfo(2)[0] == static_cast<byte>(0x42));
+  REQUIRE(scene.unk3() == 77);
+  REQUIRE(scene.text() == "\x82\xa0" "A");
+  REQUIRE(static_cast<const void*>(scene.text().data()) ==
+          image.data() + text_offset);
+
+  REQUIRE(view.table1_count() == 1);
+  REQUIRE(view.table1(0) == "TABLE");
+  REQUIRE(view.bg_count() == 1);
+  REQUIRE(view.bg(0).name() == "bg01");
+  REQUIRE(view.bg(0).abbreviation() == string(fixed_string_size, 'b'));
+  REQUIRE(view.variable_count() == 0);
+
+  SCXFile scxfile;
+  REQUIRE(scxfile.read(view));
+  REQUIRE(scxfile.scene(0).text == u8"あA");
+  REQUIRE(scxfile.scene(0).sceneJump4 == 10);
+  REQUIRE(scxfile.scene(0).unk3 == 77);
+  REQUIRE(scxfile.table1(0).data == "TABLE");
+  REQUIRE(scxfile.bg(0).name == "bg01");
+}
+
+TEST_CASE("SCXView keeps text within the file") {
+  // Unterminated at the end of the file
+  auto image = small_image("AB");
+  SCXView view;
+  REQUIRE(view.view(multi_span<const byte>(image)));
+  REQUIRE(view.scene(0).text() == "AB");
+
+  put(image, SCXFileHeader::scene_string_offsets_offset,
+      static_cast<uint32_t>(image.size()));
+  REQUIRE_FALSE(view.view(multi_span<const byte>(image)));
+  // Still viewing the last good image
+  REQUIRE(view.scene_count() == 1);
+
+  REQUIRE_FALSE(view.read("bananas.scx"));
+}
+
+TEST_CASE("SCXView bounds text by the section which follows it") {
+  // The table1 string fills its buffer, so text from within it has no null
+  // before the BG names
+  auto image = small_image("AB");
+  put(image, table1_offset, string(fixed_string_size, 'T'));
+  put(image, SCXFileHeader::scene_string_offsets_offset,
+      static_cast<uint32_t>(bg_offset - 4));
+  SCXView view;
+  REQUIRE(view.view(multi_span<const byte>(image)));
+  REQUIRE(view.scene(0).text() == "TTTT");
+
+  // As SCXFile bounds it when reading the file itself
+  SCXFile scxfile;
+  REQUIRE(scxfile.read(view));
+  REQUIRE(scxfile.scene(0).text == "TTTT");
+}
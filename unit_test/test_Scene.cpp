@@ -0,0 +1,87 @@
+#include "catch.hpp"
+
+#include "Scene.hpp"
+#include "SceneJumpPool.hpp"
+
+#include <array>
+using std::array;
+#include <memory>
+using std::make_shared;
+using std::shared_ptr;
+
+#include <cstddef>
+using std::size_t;
+
+#include <gsl/gsl>
+using gsl::byte;
+
+namespace {
+using blob = array<byte, Scene::blob_size>;
+
+// The blob of a scene with jumps 2 and 4 set, which start at byte 20
+blob make_blob(byte fill) {
+  blob data = {};
+  data[0] = static_cast<byte>(7);
+  for (size_t i = 0; i < Scene::scene_jump_blob_size; ++i) {
+    data[20 + Scene::scene_jump_blob_size + i] = fill;
+    data[20 + 3 * Scene::scene_jump_blob_size + i] = static_cast<byte>(i);
+  }
+  data[0xd4] = static_cast<byte>(0x99);
+  return data;
+}
+}
+
+TEST_CASE("Scene keeps only the scene jump blobs which are not all zero") {
+  const blob data = make_blob(static_cast<byte>(0x42));
+  Scene scene;
+  scene.read_data(nullptr, Scene::blob_span(data));
+  REQUIRE(scene.chapter == 7);
+  REQUIRE(scene.unk3 == 0x99);
+  REQUIRE_FALSE(scene.has_sceneJumpInfo(1));
+  REQUIRE(scene.has_sceneJumpInfo(2));
+  REQUIRE_FALSE(scene.has_sceneJumpInfo(3));
+  REQUIRE(scene.has_sceneJumpInfo(4));
+  REQUIRE(scene.sceneJumpInfo(1) == Scene::scene_jump_blob{});
+  REQUIRE(scene.sceneJumpInfo(2)[47] == static_cast<byte>(0x42));
+  REQUIRE(scene.sceneJumpInfo(4)[47] == static_cast<byte>(47));
+
+  blob written = {};
+  scene.write_data(Scene::blob_span_out(written));
+  REQUIRE(written == data);
+
+  const Scene empty;
+  REQUIRE_FALSE(empty.has_sceneJumpInfo(2));
+  empty.write_data(Scene::blob_span_out(written));
+  REQUIRE(written == blob{});
+}
+
+TEST_CASE("Scenes read from one file share their scene jump blobs") {
+  const auto jumps = make_shared<SceneJumpPool>();
+  const blob first = make_blob(static_cast<byte>(0x42));
+  const blob second = make_blob(static_cast<byte>(0x42));
+  const blob third = make_blob(static_cast<byte>(0x43));
+  const shared_ptr<const void> no_owner;
+  Scene scenes[3];
+  scenes[0].read_data(nullptr, Scene::blob_span(first), no_owner, jumps);
+  scenes[1].read_data(nullptr, Scene::blob_span(second), no_owner, jumps);
+  scenes[2].read_data(nullptr, Scene::blob_span(third), no_owner, jumps);
+  REQUIRE(jumps->size() == 3);
+  REQUIRE(&scenes[0].sceneJumpInfo(4) == &scenes[2].sceneJumpInfo(4));
+
+  // Changing one scene leaves the others, and the shared pool, alone
+  Scene::scene_jump_blob info = {};
+  info[0] = static_cast<byte>(1);
+  scenes[1].set_sceneJumpInfo(1, info);
+  scenes[1].set_sceneJumpInfo(2, Scene::scene_jump_blob{});
+  REQUIRE(jumps->size() == 3);
+  REQUIRE(scenes[1].has_sceneJumpInfo(1));
+  REQUIRE_FALSE(scenes[1].has_sceneJumpInfo(2));
+  REQUIRE(scenes[1].sceneJumpInfo(4) == scenes[0].sceneJumpInfo(4));
+  REQUIRE(scenes[0].sceneJumpInfo(2)[0] == static_cast<byte>(0x42));
+
+  blob written = {};
+  scenes[0].write_data(Scene::blob_span_out(written));
+  REQUIRE(written == first);
+  scenes[2].write_data(Scene::blob_span_out(written));
+  REQUIRE(written == third);
+}
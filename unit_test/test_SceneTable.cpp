@@ -0,0 +1,50 @@
+#include "catch.hpp"
+
+#include "SceneTable.hpp"
+
+#include <vector>
+using std::vector;
+
+#include <cstddef>
+using std::size_t;
+#include <cstdint>
+using std::uint16_t;
+
+namespace {
+Scene make_scene(uint16_t chapter, uint16_t command) {
+  Scene scene{};
+  scene.chapter = chapter;
+  scene.command = command;
+  Scene::scene_jump_blob info;
+  info.fill(static_cast<gsl::byte>(0x42));
+  scene.set_sceneJumpInfo(2, info);
+  return scene;
+}
+}
+
+TEST_CASE("SceneTable selects scenes by column") {
+  SceneTable table;
+  vector<size_t> expected;
+  // Long enough to cover whole blocks and a tail
+  for (size_t i = 0; i < 37; ++i) {
+    const auto chapter = static_cast<uint16_t>(i % 3);
+    const auto command = static_cast<uint16_t>(i % 5 == 0 ? 0xffff : 7);
+    auto scene = make_scene(chapter, command);
+    scene.text = std::to_string(i);
+    table.push_back(scene);
+    if (chapter == 2 && command == 0xffff) {
+      expected.push_back(i);
+    }
+  }
+
+  REQUIRE(table.size() == 37);
+  REQUIRE(table.select(2, 0xffff) == expected);
+  REQUIRE(SceneTable::select(table.chapter, 1).size() == 12);
+  REQUIRE(SceneTable::select(table.command, 3).empty());
+
+  const Scene scene = table.scene_at(20);
+  REQUIRE(scene.text == "20");
+  REQUIRE(scene.chapter == 2);
+  REQUIRE(scene.command == 0xffff);
+  REQUIRE(scene.sceneJumpInfo(2)[47] == static_cast<gsl::byte>(0x42));
+}